@@ -1,10 +1,17 @@
 
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <algorithm>
+#include <optional>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "llvm-c/Core.h"
 
@@ -14,18 +21,67 @@
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/IR/LegacyPassManager.h"
-#include "llvm/LinkAllPasses.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/RecyclingAllocator.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/TypeFinder.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/ScopedNoAliasAA.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TypeBasedAliasAnalysis.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Support/raw_ostream.h"
 
+// Built with -DP2_PLUGIN, this file is the opt plugin instead of the p2 tool
+#ifdef P2_PLUGIN
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#else
+#include "llvm/LinkAllPasses.h"
+#endif
+
 using namespace llvm;
 
 // Define a macro to enable/disable debugging output
@@ -38,27 +94,87 @@ using namespace llvm;
 #endif
 
 void debugPrintLLVMInstr(Instruction &I) {
+#if DEBUG_PRINT_EN
     // convert to string
     std::string InstStr;
     raw_string_ostream OS(InstStr);
+    OS << I;
     // Use the debug print macro
     DEBUG_PRINT("Instruction:" << InstStr);
+#else
+    (void)I;
+#endif
 }
 
-static void DeadCodeElimination(Module *);
-static void SimplifyInstructions(Module *);
-static void CommonSubexpressionElimination(Module *);
-static void EliminateRedundantLoads(Module *);
-static void EliminateRedundantStores(Module *);
+class CSEWorklist;
+class CSEAnalyses;
+
+static void DeadCodeElimination(Function &, CSEWorklist &);
+static void AggressiveDeadCodeElimination(Function &, CSEWorklist &, CSEAnalyses &);
+static void SimplifyInstructions(Function &, CSEWorklist &, CSEAnalyses &);
+static void ReassociateExpressions(Function &, CSEWorklist &, CSEAnalyses &);
+static void EliminateRedundantLoads(Function &, CSEWorklist &, CSEAnalyses &);
+static void EliminateRedundantStores(Function &, CSEWorklist &, CSEAnalyses &);
+static void EliminateCrossBlockLoads(Function &, CSEWorklist &, CSEAnalyses &);
+static bool isEquivalentMatch(Instruction &, Instruction &);
+
+// The plugin registers these options with opt as well
+static cl::opt<bool>
+        MemSSALoads("memssa-loads",
+                    cl::desc("Use MemorySSA to eliminate redundant loads across basic blocks."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        NoMathErrno("no-math-errno",
+                    cl::desc("Assume math library calls never set errno, so they can be folded, "
+                             "removed and merged."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        AggressiveDCE("aggressive-dce",
+                      cl::desc("Remove every instruction no side effect depends on, fold constant branches "
+                               "and delete unreachable blocks."),
+                      cl::init(false));
+
+#ifndef P2_PLUGIN
+static void CommonSubexpressionElimination(Module *, const SmallPtrSetImpl<Function*> &);
+static void InferFunctionAttributes(Module &M);
 
 static void summarize(Module *M);
 static void print_csv_file(std::string outputfile);
 
+static int optimizeFile(const std::string &inputfile, const std::string &outputfile, const char *argv0,
+                        LLVMContext &Context);
+static int runBatch(const char *argv0);
+static int runServer(const char *argv0);
+
+static std::string computeCacheKey(const MemoryBuffer &input, const std::string &outputfile);
+static bool fetchFromCache(const std::string &key, const std::string &outputfile);
+static void storeInCache(const std::string &key, const std::string &outputfile);
+static bool publishCacheFile(const std::string &from, const std::string &to);
+
+/**
+ * @brief Structural fingerprints of a module's input IR, used by -incremental-dir.
+ */
+struct ModuleFingerprints {
+    std::string ModuleHash;            // options, data layout, types and globals
+    StringMap<std::string> Functions;  // function name -> hash of its input IR
+};
+
+static std::string incrementalPath(const std::string &outputfile, StringRef ext);
+static void computeFingerprints(Module &M, ModuleFingerprints &FP);
+static void reusePriorResults(Module &M, const ModuleFingerprints &FP, const std::string &outputfile,
+                              SmallPtrSetImpl<Function*> &Reused);
+static void savePriorResults(const ModuleFingerprints &FP, const std::string &outputfile);
+static int saveCachedPriorResults(const MemoryBuffer &input, const std::string &outputfile, const char *argv0,
+                                  LLVMContext &Context);
+
+// Both are required unless -server is given, which main checks after parsing
 static cl::opt<std::string>
-        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
+        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Optional, cl::init("-"));
 
 static cl::opt<std::string>
-        OutputFilename(cl::Positional, cl::desc("<output bitcode>"), cl::Required, cl::init("out.bc"));
+        OutputFilename(cl::Positional, cl::desc("<output bitcode>"), cl::Optional, cl::init("out.bc"));
 
 static cl::opt<bool>
         Mem2Reg("mem2reg",
@@ -80,6 +196,59 @@ static cl::opt<bool>
                 cl::desc("Do not check for valid IR."),
                 cl::init(false));
 
+static cl::opt<bool>
+        Batch("batch",
+              cl::desc("Treat <input bitcode> as a manifest or directory of .ll/.bc files "
+                       "and <output bitcode> as the directory to write them to."),
+              cl::init(false));
+
+static cl::opt<unsigned>
+        Workers("workers",
+                cl::desc("Number of worker processes in batch mode (default: one per core)."),
+                cl::init(0));
+
+static cl::opt<std::string>
+        ServerSocket("server",
+                     cl::desc("Serve optimization requests on this Unix domain socket."),
+                     cl::value_desc("socket"),
+                     cl::init(""));
+
+static cl::opt<unsigned>
+        MaxRequestMB("max-request-size",
+                     cl::desc("Largest buffer request the -server accepts, in megabytes."),
+                     cl::init(256));
+
+static cl::opt<std::string>
+        CacheDir("cache-dir",
+                 cl::desc("Reuse optimized bitcode and statistics from this directory."),
+                 cl::value_desc("dir"),
+                 cl::init(""));
+
+static cl::opt<unsigned>
+        CacheSizeMB("cache-size",
+                    cl::desc("Maximum size of the -cache-dir directory in megabytes."),
+                    cl::init(1024));
+
+static cl::opt<std::string>
+        IncrementalDir("incremental-dir",
+                       cl::desc("Reuse the optimized body of every function unchanged since the "
+                                "previous run recorded in this directory."),
+                       cl::value_desc("dir"),
+                       cl::init(""));
+
+static cl::opt<unsigned>
+        Jobs("j",
+             cl::desc("Optimize functions on N threads."),
+             cl::value_desc("N"),
+             cl::Prefix,
+             cl::init(1));
+
+static cl::opt<bool>
+        InferAttrs("infer-attrs",
+                   cl::desc("Infer the memory effects and nocapture arguments of the defined functions "
+                            "before CSE."),
+                   cl::init(false));
+
 
 /**
  * @brief Prints the contents of the given LLVM module for debugging purposes.
@@ -116,29 +285,93 @@ int main(int argc, char **argv) {
 
     // Handle creating output files and shutting down properly
     llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+
+    EnableStatistics();
+
+    if (!ServerSocket.empty()) {
+        return runServer(argv[0]);
+    }
+
+    if (InputFilename.getNumOccurrences() == 0 || OutputFilename.getNumOccurrences() == 0) {
+        errs() << argv[0] << ": Not enough positional command line arguments specified!\n"
+               << "Must specify at least 2 positional arguments: See: " << argv[0] << " -help\n";
+        return 1;
+    }
+
+    if (Batch) {
+        return runBatch(argv[0]);
+    }
+
     LLVMContext Context;
+    return optimizeFile(InputFilename, OutputFilename, argv[0], Context);
+}
+
+
+/**
+ * @brief Reads, optimizes and writes a single module.
+ *
+ * The module is created in the given context and destroyed before returning.
+ * Batch workers pass a fresh context per file, so the bitcode written for a
+ * file does not depend on which other files were handled before it.
+ *
+ * @param inputfile Path of the .ll or .bc file to read.
+ * @param outputfile Path of the bitcode to write, the statistics go to outputfile.stats.
+ * @param argv0 Program name used in diagnostics.
+ * @param Context The LLVMContext to create the module in.
+ * @return 0 on success, 1 if the input or a function body could not be read or the result is broken.
+ */
+static int optimizeFile(const std::string &inputfile, const std::string &outputfile, const char *argv0,
+                        LLVMContext &Context) {
+    // Read the input once, the same bytes are hashed for the cache and parsed
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFileOrSTDIN(inputfile);
+    if (std::error_code EC = Buffer.getError()) {
+        SMDiagnostic(inputfile, SourceMgr::DK_Error,
+                     "Could not open input file: " + EC.message()).print(argv0, errs());
+        return 1;
+    }
+
+    // A cache hit already has the bitcode and statistics this run would produce
+    std::string CacheKey;
+    if (!CacheDir.empty() && outputfile != "-") {
+        CacheKey = computeCacheKey(**Buffer, outputfile);
+        if (fetchFromCache(CacheKey, outputfile)) {
+            return IncrementalDir.empty() ? 0 : saveCachedPriorResults(**Buffer, outputfile, argv0, Context);
+        }
+    }
 
     // LLVM idiom for constructing output file.
     std::unique_ptr<ToolOutputFile> Out;
     std::string ErrorInfo;
     std::error_code EC;
-    Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC,
+    Out.reset(new ToolOutputFile(outputfile.c_str(), EC,
                                  sys::fs::OF_None));
 
-    EnableStatistics();
-
     // Read in module
     SMDiagnostic Err;
-    std::unique_ptr<Module> M;
-    M = parseIRFile(InputFilename, Err, Context);
+    std::unique_ptr<Module> M = parseIR((*Buffer)->getMemBufferRef(), Err, Context);
 
     // If errors, fail
     if (M.get() == 0)
     {
-        Err.print(argv[0], errs());
+        Err.print(argv0, errs());
         return 1;
     }
 
+    // A server parses the next module into the same context, which would rename clashing struct types
+    auto ReleaseTypeNames = make_scope_exit([&M] {
+        if (!ServerSocket.empty()) {
+            for (StructType *ST : M->getIdentifiedStructTypes()) {
+                ST->setName("");
+            }
+        }
+    });
+
+    // Fingerprint the input before anything changes it
+    ModuleFingerprints Fingerprints;
+    if (!IncrementalDir.empty()) {
+        computeFingerprints(*M, Fingerprints);
+    }
+
     // If requested, do some early optimizations
     if (Mem2Reg)
     {
@@ -147,23 +380,32 @@ int main(int argc, char **argv) {
         Passes.run(*M.get());
     }
 
+    // Callers are optimized knowing what their callees do, so this runs on the whole module first
+    if (InferAttrs && !NoCSE) {
+        InferFunctionAttributes(*M);
+    }
+
+    SmallPtrSet<Function*, 16> Reused;
+    if (!IncrementalDir.empty()) {
+        reusePriorResults(*M, Fingerprints, outputfile, Reused);
+    }
+
     if (!NoCSE) {
-        CommonSubexpressionElimination(M.get());
+        CommonSubexpressionElimination(M.get(), Reused);
     }
 
     // Collect statistics on Module
     summarize(M.get());
-    print_csv_file(OutputFilename);
+    print_csv_file(outputfile);
 
     if (Verbose)
         PrintStatistics(errs());
 
-    // Verify integrity of Module, do this by default
-    if (!NoCheck)
+    // Verify integrity of Module, do this by default. A broken module is not fatal so a server keeps running
+    if (!NoCheck && verifyModule(*M.get(), &errs()))
     {
-        legacy::PassManager Passes;
-        Passes.add(createVerifierPass());
-        Passes.run(*M.get());
+        errs() << argv0 << ": Broken module found, compilation aborted!\n";
+        return 1;
     }
 
     // Write final bitcode
@@ -171,630 +413,3837 @@ int main(int argc, char **argv) {
     Out->keep();
     if (DEBUG_PRINT_EN) debugPrintModule(M.get());
 
+    if (!CacheKey.empty()) {
+        Out->os().flush();
+        storeInCache(CacheKey, outputfile);
+    }
+    if (!IncrementalDir.empty() && outputfile != "-") {
+        Out->os().flush();
+        savePriorResults(Fingerprints, outputfile);
+    }
+
     return 0;
 }
 
 
-static llvm::Statistic nFunctions = {"", "Functions", "number of functions"};
-static llvm::Statistic nInstructions = {"", "Instructions", "number of instructions"};
-static llvm::Statistic nLoads = {"", "Loads", "number of loads"};
-static llvm::Statistic nStores = {"", "Stores", "number of stores"};
+/**
+ * @brief Collects the (input, output) pairs of a batch run.
+ *
+ * A directory contributes every .ll and .bc file in it, in name order. Any
+ * other path is read as a manifest with one input per line, optionally
+ * followed by the output path; empty lines and lines starting with '#' are
+ * skipped. Outputs without an explicit path go to outdir/<stem>.bc.
+ *
+ * @param input Path of the manifest or directory.
+ * @param outdir Directory for outputs that are not named in the manifest.
+ * @param files Receives the (input, output) pairs.
+ * @return An error code if the manifest or directory could not be read.
+ */
+static std::error_code collectBatchFiles(const std::string &input, const std::string &outdir,
+                                         std::vector<std::pair<std::string, std::string>> &files) {
+    auto defaultOutput = [&outdir](StringRef inputfile) {
+        SmallString<128> Path(outdir);
+        sys::path::append(Path, sys::path::stem(inputfile) + ".bc");
+        return std::string(Path.str());
+    };
 
-static void summarize(Module *M) {
-    for (auto i = M->begin(); i != M->end(); i++) {
-        if (i->begin() != i->end()) {
-            nFunctions++;
+    std::error_code EC;
+    if (sys::fs::is_directory(input)) {
+        std::vector<std::string> inputs;
+        for (sys::fs::directory_iterator I(input, EC), E; I != E && !EC; I.increment(EC)) {
+            StringRef Ext = sys::path::extension(I->path());
+            if (Ext == ".ll" || Ext == ".bc") {
+                inputs.push_back(I->path());
+            }
         }
+        std::sort(inputs.begin(), inputs.end());
+        for (const std::string &inputfile : inputs) {
+            files.emplace_back(inputfile, defaultOutput(inputfile));
+        }
+        return EC;
+    }
 
-        for (auto j = i->begin(); j != i->end(); j++) {
-            for (auto k = j->begin(); k != j->end(); k++) {
-                Instruction &I = *k;
-                nInstructions++;
-                if (isa<LoadInst>(&I)) {
-                    nLoads++;
-                } else if (isa<StoreInst>(&I)) {
-                    nStores++;
-                }
-            }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Manifest = MemoryBuffer::getFile(input);
+    if (!Manifest) {
+        return Manifest.getError();
+    }
+
+    SmallVector<StringRef, 64> Lines;
+    (*Manifest)->getBuffer().split(Lines, '\n');
+    for (StringRef Line : Lines) {
+        Line = Line.trim();
+        if (Line.empty() || Line.startswith("#")) {
+            continue;
         }
+        std::pair<StringRef, StringRef> Fields = Line.split(' ');
+        StringRef outputfile = Fields.second.trim();
+        files.emplace_back(Fields.first.str(),
+                           outputfile.empty() ? defaultOutput(Fields.first) : outputfile.str());
     }
+    return EC;
 }
 
-static void print_csv_file(std::string outputfile)
-{
-    std::ofstream stats(outputfile + ".stats");
-    auto a = GetStatistics();
-    for (auto p : a) {
-        stats << p.first.str() << "," << p.second << std::endl;
+
+/**
+ * @brief Optimizes every file named by a manifest or directory in one process.
+ *
+ * The files are handed out to a pool of forked worker processes through a
+ * shared counter, so a large module does not hold up the files queued behind
+ * it. Statistics are process global, forking keeps them per worker and they
+ * are reset before each file, so every .stats file matches a single run.
+ *
+ * @param argv0 Program name used in diagnostics.
+ * @return 0 if every file was optimized, 1 otherwise.
+ */
+static int runBatch(const char *argv0) {
+    std::vector<std::pair<std::string, std::string>> files;
+    if (std::error_code EC = collectBatchFiles(InputFilename, OutputFilename, files)) {
+        errs() << argv0 << ": " << InputFilename << ": " << EC.message() << "\n";
+        return 1;
     }
-    stats.close();
+    if (std::error_code EC = sys::fs::create_directories(OutputFilename)) {
+        errs() << argv0 << ": " << OutputFilename << ": " << EC.message() << "\n";
+        return 1;
+    }
+
+    unsigned NumWorkers = Workers ? Workers : hardware_concurrency().compute_thread_count();
+    NumWorkers = std::max(1u, std::min<unsigned>(NumWorkers, files.size()));
+
+    auto runWorker = [&](std::atomic<size_t> &NextFile) {
+        int failed = 0;
+        for (size_t i = NextFile++; i < files.size(); i = NextFile++) {
+            ResetStatistics();
+            LLVMContext Context;
+            failed |= optimizeFile(files[i].first, files[i].second, argv0, Context);
+        }
+        return failed;
+    };
+
+    if (NumWorkers == 1) {
+        std::atomic<size_t> NextFile(0);
+        return runWorker(NextFile);
+    }
+
+    // The counter lives in shared memory so all workers draw from the same queue
+    void *Shared = mmap(nullptr, sizeof(std::atomic<size_t>), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (Shared == MAP_FAILED) {
+        errs() << argv0 << ": cannot create the batch queue\n";
+        return 1;
+    }
+    std::atomic<size_t> *NextFile = new (Shared) std::atomic<size_t>(0);
+
+    outs().flush();
+    errs().flush();
+    std::vector<pid_t> pids;
+    for (unsigned w = 0; w < NumWorkers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int failed = runWorker(*NextFile);
+            outs().flush();
+            errs().flush();
+            _exit(failed);
+        }
+        if (pid < 0) {
+            errs() << argv0 << ": cannot start batch worker\n";
+            break;
+        }
+        pids.push_back(pid);
+    }
+
+    int failed = pids.empty() ? 1 : 0;
+    for (pid_t pid : pids) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    munmap(Shared, sizeof(std::atomic<size_t>));
+    return failed;
 }
 
-static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
-static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
-static llvm::Statistic CSESimplify = {"", "CSESimplify", "CSE simplified instructions"};
-static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
-static llvm::Statistic CSEStore2Load = {"", "CSEStore2Load", "CSE forwarded store to load"};
-static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
 
 // --------------------------------------------------------------------------------
-//                      Optimization 0: Dead Code Elimination
+//                      Server mode
 // --------------------------------------------------------------------------------
 /**
- * @brief Checks if the given LLVM instruction is dead, i.e., has no uses and can be safely removed.
- * 
- * This function examines the opcode of the instruction to determine if it falls into one of the categories
- * of instructions that can be considered dead. Instructions such as arithmetic, bitwise, conversion, and
- * memory-related instructions are checked to ensure they have no uses. If an instruction is a load, it is
- * further checked to ensure it is not volatile.
- * 
- * @param I Reference to the LLVM instruction to be checked.
- * @return True if the instruction is dead, false otherwise.
+ * @brief Writes the whole buffer to a socket.
+ *
+ * @return true if every byte was written.
  */
-bool isDead(Instruction &I) { 
-    int opcode = I.getOpcode();
-
-    switch(opcode) {
-        // Instructions that do not produce a value
-        case Instruction::Add:
-        case Instruction::FNeg:
-        case Instruction::FAdd: 	
-        case Instruction::Sub:
-        case Instruction::FSub: 	
-        case Instruction::Mul:
-        case Instruction::FMul: 	
-        case Instruction::UDiv:	
-        case Instruction::SDiv:	
-        case Instruction::FDiv:	
-        case Instruction::URem: 	
-        case Instruction::SRem: 	
-        case Instruction::FRem:
-        case Instruction::Shl: 	
-        case Instruction::LShr: 	
-        case Instruction::AShr: 	
-        case Instruction::And: 	
-        case Instruction::Or: 	
-        case Instruction::Xor:
-        case Instruction::GetElementPtr: 	
-        case Instruction::Trunc: 	
-        case Instruction::ZExt: 	
-        case Instruction::SExt: 	
-        case Instruction::FPToUI: 	
-        case Instruction::FPToSI: 	
-        case Instruction::UIToFP: 	
-        case Instruction::SIToFP: 	
-        case Instruction::FPTrunc: 	
-        case Instruction::FPExt: 	
-        case Instruction::PtrToInt: 	
-        case Instruction::IntToPtr: 	
-        case Instruction::BitCast: 	
-        case Instruction::AddrSpaceCast: 	
-        case Instruction::ICmp: 	
-        case Instruction::FCmp: 	
-        case Instruction::ExtractElement: 	
-        case Instruction::InsertElement: 	
-        case Instruction::ShuffleVector: 	
-        case Instruction::ExtractValue: 	
-        case Instruction::InsertValue:
-        case Instruction::Alloca:
-        case Instruction::PHI: 
-        case Instruction::Select: 
-            // Check if the instruction has no uses
-            if (I.use_begin() == I.use_end()) 
-                return true;
-            break;
-
-        // Load instruction
-        case Instruction::Load:
-        {
-            LoadInst *LI = dyn_cast<LoadInst>(&I);
-            // Check if the load instruction is volatile
-            if (LI && LI->isVolatile())
-                return false;
-            // Check if the load instruction has no uses
-            if (I.use_begin() == I.use_end())
-                return true;
-            break;
+static bool writeAll(int fd, StringRef data) {
+    while (!data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-          
-        default: 
-            // Any other opcode fails the test
+        if (n <= 0) {
             return false;
+        }
+        data = data.drop_front(n);
     }
-    return false;
+    return true;
 }
 
 
 /**
- * @brief Performs dead code elimination (DCE) on the given LLVM module.
- * 
- * This function iterates over all functions and basic blocks in the module,
- * identifies dead instructions within each basic block, and removes them.
- * Dead instructions are those that have no uses or are determined to be
- * dead based on specific opcode rules.
- * 
- * @param M Pointer to the LLVM module to perform DCE on.
+ * @brief Reads from a socket up to a newline, which is not included.
+ *
+ * @return true if a complete line was read.
  */
-static void DeadCodeElimination(Module *M) {
-    DEBUG_PRINT("DCE start\n");
-
-    // Iterate over all functions in the module
-    for (Function &F : *M) {
-        // Iterate over all basic blocks in the function
-        for (BasicBlock &BB : F) {
-            std::vector<Instruction*> deadInstList;
+static bool readLine(int fd, std::string &line) {
+    line.clear();
+    char c;
+    while (true) {
+        ssize_t n = ::read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line += c;
+    }
+}
 
-            // Iterate over all instructions in the basic block
-            for (Instruction &I : BB) {
-                // Check if the instruction is dead
-                std::vector<Instruction*> deadInstList;
-                if (isDead(I)) {
-                    deadInstList.push_back(&I);
-                }
-            }
 
-            // Remove dead instructions from the basic block
-            if (deadInstList.size() > 0) {
-                for (Instruction *deadInst : deadInstList) {
-                    DEBUG_PRINT("erasing dead instruction: \n\t");
-                    debugPrintLLVMInstr(*deadInst);
-                    DEBUG_PRINT("\n");
-                    deadInst->eraseFromParent();
-                    CSEDead++;
-                }
-            }
+/**
+ * @brief Reads exactly size bytes from a socket.
+ *
+ * @return true if all bytes were read.
+ */
+static bool readAll(int fd, size_t size, std::string &data) {
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, &data[done], size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
         }
+        done += n;
     }
-
-    DEBUG_PRINT("DCE end\n");
+    return true;
 }
 
 
-// --------------------------------------------------------------------------------
-//                      Optimization 1: Simplify Instructions
-// --------------------------------------------------------------------------------
 /**
- * @brief Simplifies instructions within the given LLVM module.
- * 
- * This function iterates over all functions and basic blocks in the module,
- * simplifies instructions, and replaces them with simplified values if possible.
- * Simplified instructions are those that can be simplified using LLVM's
- * built-in simplification rules.
- * 
- * @param M Pointer to the LLVM module to simplify instructions in.
+ * @brief Reads a whole file into a string.
+ *
+ * @return true if the file could be read.
  */
-static void SimplifyInstructions(Module *M) {
-    DEBUG_PRINT("Simplify instruction start\n");
+static bool readFile(const std::string &path, std::string &data) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(path);
+    if (!Buffer) {
+        return false;
+    }
+    data = (*Buffer)->getBuffer().str();
+    return true;
+}
 
-    // Iterate over all functions in the module
-    for (Function &F : *M) {
-        // Iterate over all basic blocks in the function
-        for (BasicBlock &BB : F) {
-            std::vector<Instruction*> toEraseSimplify;
 
-            // Iterate over all instructions in the basic block
-            for (Instruction &I : BB) {
-                // Simplify the instruction
-                Value *val = simplifyInstruction(&I, M->getDataLayout());
+/**
+ * @brief Sets the optimization options for one request and restores them afterwards.
+ */
+class RequestOptions {
+public:
+    RequestOptions()
+        : SavedMem2Reg(Mem2Reg), SavedNoCSE(NoCSE), SavedNoCheck(NoCheck),
+          SavedMemSSALoads(MemSSALoads), SavedAggressiveDCE(AggressiveDCE), SavedInferAttrs(InferAttrs),
+          SavedNoMathErrno(NoMathErrno) {}
 
-                // If the instruction was simplified, replace it with the simplified value
-                if (val != nullptr) {
-                    I.replaceAllUsesWith(val);
-                    toEraseSimplify.push_back(&I);
-                }
-            }
+    ~RequestOptions() {
+        Mem2Reg = SavedMem2Reg;
+        NoCSE = SavedNoCSE;
+        NoCheck = SavedNoCheck;
+        MemSSALoads = SavedMemSSALoads;
+        AggressiveDCE = SavedAggressiveDCE;
+        InferAttrs = SavedInferAttrs;
+        NoMathErrno = SavedNoMathErrno;
+    }
 
-            // Remove simplified instructions from the basic block
-            if (toEraseSimplify.size() > 0) {
-                // Erase the instructions marked for elimination (simplification
-                for (Instruction *I : toEraseSimplify) {
-                    DEBUG_PRINT("erasing simplified instruction:\n\t");
-                    debugPrintLLVMInstr(*I);
-                    DEBUG_PRINT("\n");
-                    I->eraseFromParent();
-                    CSESimplify++;
-                }
-            }
+    /**
+     * @brief Applies one request option.
+     *
+     * @return false if the option is not one a request may set.
+     */
+    bool apply(StringRef option) {
+        if (option == "-mem2reg") {
+            Mem2Reg = true;
+        } else if (option == "-no-cse") {
+            NoCSE = true;
+        } else if (option == "-no") {
+            NoCheck = true;
+        } else if (option == "-memssa-loads") {
+            MemSSALoads = true;
+        } else if (option == "-aggressive-dce") {
+            AggressiveDCE = true;
+        } else if (option == "-infer-attrs") {
+            InferAttrs = true;
+        } else if (option == "-no-math-errno") {
+            NoMathErrno = true;
+        } else {
+            return false;
         }
+        return true;
     }
 
-    DEBUG_PRINT("Simplify instruction end\n");
-}
+private:
+    bool SavedMem2Reg, SavedNoCSE, SavedNoCheck, SavedMemSSALoads, SavedAggressiveDCE, SavedInferAttrs,
+         SavedNoMathErrno;
+};
 
 
-// --------------------------------------------------------------------------------
-//                      Optimization 2: Common Subexpression Elimination
-// --------------------------------------------------------------------------------
 /**
- * @brief Checks if the given LLVM instruction has side effects.
- * 
- * This function determines whether the given instruction has side effects
- * based on its opcode. Instructions with certain opcodes are considered
- * to have side effects, such as calls, stores, allocations, loads, etc.
- * 
- * @param I Reference to the LLVM instruction to be checked.
- * @return true if the instruction has side effects, false otherwise.
+ * @brief Serves one connection, which carries exactly one request.
+ *
+ * Requests are a single header line of space separated words:
+ *   path [options] <input> <output>   optimize a file, like a normal run
+ *   buffer [options] <size>           optimize the <size> bytes of IR that follow
+ *   shutdown                          stop the server
+ * The options are -mem2reg, -no-cse, -no, -memssa-loads, -aggressive-dce, -infer-attrs and
+ * -no-math-errno. A buffer larger than -max-request-size is refused before it
+ * is read. The reply starts with "ok <bitcode size> <stats size>" or
+ * "error <message>" on its own line; an ok is followed by the bitcode (empty
+ * for path requests, which write <output>) and the contents of the .stats file.
+ *
+ * @param fd The connected socket.
+ * @param argv0 Program name used in diagnostics.
+ * @param Context The warm context the module is created in.
+ * @return false if the server should shut down.
  */
-static bool isSideEffectInstruction(Instruction &I) {
-    // Check if the opcode of the instruction indicates a side effect
-    return (
-        (I.getOpcode() == Instruction::Call)        ||
-        (I.getOpcode() == Instruction::Store)       ||
-        (I.getOpcode() == Instruction::Alloca)      ||
-        (I.getOpcode() == Instruction::Load)        ||
-        (I.getOpcode() == Instruction::Fence)       ||
-        (I.getOpcode() == Instruction::Br)          ||
-        (I.getOpcode() == Instruction::Invoke)      ||
-        (I.getOpcode() == Instruction::Resume)      ||
-        (I.getOpcode() == Instruction::Unreachable)
-    );
-}
+static bool serveRequest(int fd, const char *argv0, LLVMContext &Context) {
+    std::string header;
+    if (!readLine(fd, header)) {
+        return true;
+    }
 
+    SmallVector<StringRef, 8> words;
+    StringRef(header).split(words, ' ', -1, /*KeepEmpty=*/false);
+    if (words.size() == 1 && words[0] == "shutdown") {
+        writeAll(fd, "ok 0 0\n");
+        return false;
+    }
 
-/**
- * @brief Checks if the given LLVM instructions match each other as literals.
- * 
- * This function compares two LLVM instructions to determine if they match
- * each other as literals. Matching requires the instructions to have the
- * same opcode, type, number of operands, and order of operands. Additionally,
- * for compare instructions (FCmp and ICmp), their predicates must match.
- * 
- * @param I Reference to the first LLVM instruction to be compared.
- * @param J Reference to the second LLVM instruction to be compared.
- * @return true if the instructions match as literals, false otherwise.
- */
-static bool isLiteralMatch(Instruction &I, Instruction &J) {
-    // Check if the instructions are compare instructions (FCmp or ICmp)
-    if (I.getOpcode() == Instruction::FCmp) {
-        FCmpInst *FCI = dyn_cast<FCmpInst>(&I);
-        FCmpInst *FCJ = dyn_cast<FCmpInst>(&J);
-        // If either instruction is not an FCmpInst, they don't match
-        if (!FCI || !FCJ) {
-            return false;
-        }
-        // If the predicates of the FCmpInsts don't match, they don't match as literals
-        if (FCI->getPredicate() != FCJ->getPredicate()) {
-            return false;
+    RequestOptions Options;
+    size_t operands = words.empty() ? 0 : (words[0] == "path" ? 2 : (words[0] == "buffer" ? 1 : 0));
+    if (operands == 0 || words.size() < operands + 1) {
+        writeAll(fd, "error malformed request\n");
+        return true;
+    }
+    for (StringRef option : ArrayRef<StringRef>(words).slice(1, words.size() - 1 - operands)) {
+        if (!Options.apply(option)) {
+            writeAll(fd, "error unknown option " + option.str() + "\n");
+            return true;
         }
     }
-    else if (I.getOpcode() == Instruction::ICmp) {
-        ICmpInst *ICI = dyn_cast<ICmpInst>(&I);
-        ICmpInst *ICJ = dyn_cast<ICmpInst>(&J);
-        // If either instruction is not an ICmpInst, they don't match
-        if (!ICI || !ICJ) {
-            return false;
+
+    std::string inputfile, outputfile;
+    SmallString<128> TempInput, TempOutput;
+    if (words[0] == "path") {
+        inputfile = words[words.size() - 2].str();
+        outputfile = words.back().str();
+    } else {
+        size_t size;
+        std::string data;
+        int TempFD;
+        if (words.back().getAsInteger(10, size)) {
+            writeAll(fd, "error malformed request\n");
+            return true;
         }
-        // If the predicates of the ICmpInsts don't match, they don't match as literals
-        if (ICI->getPredicate() != ICJ->getPredicate()) {
-            return false;
+        if (size > (static_cast<size_t>(MaxRequestMB) << 20)) {
+            writeAll(fd, "error request too large\n");
+            return true;
+        }
+        if (!readAll(fd, size, data)) {
+            writeAll(fd, "error malformed request\n");
+            return true;
         }
+        if (sys::fs::createTemporaryFile("p2-server-in", "bc", TempFD, TempInput) ||
+            !writeAll(TempFD, data) ||
+            sys::fs::createTemporaryFile("p2-server-out", "bc", TempOutput)) {
+            if (!TempInput.empty()) {
+                sys::Process::SafelyCloseFileDescriptor(TempFD);
+                sys::fs::remove(TempInput);
+            }
+            writeAll(fd, "error cannot create temporary files\n");
+            return true;
+        }
+        sys::Process::SafelyCloseFileDescriptor(TempFD);
+        inputfile = std::string(TempInput.str());
+        outputfile = std::string(TempOutput.str());
     }
 
-    // Check additional conditions for literal matching
-    return (
-        (!isSideEffectInstruction(I)) &&                     // Not a side effect instruction I
-        (!isSideEffectInstruction(J)) &&                     // Not a side effect instruction J
-        (I.isIdenticalTo(&J))         &&
-        (I.getOpcode() == J.getOpcode()) &&                  // Same opcode
-        (I.getType() == J.getType()) &&                      // Same type
-        (I.getNumOperands() == J.getNumOperands()) &&        // Same number of operands
-        (std::equal(I.op_begin(), I.op_end(), J.op_begin())) // Same order of operands
-    );
+    ResetStatistics();
+    int failed = optimizeFile(inputfile, outputfile, argv0, Context);
+
+    std::string bitcode, stats;
+    bool ok = !failed && readFile(outputfile + ".stats", stats) &&
+              (TempOutput.empty() || readFile(outputfile, bitcode));
+    if (ok) {
+        writeAll(fd, "ok " + std::to_string(bitcode.size()) + " " + std::to_string(stats.size()) + "\n");
+        writeAll(fd, bitcode);
+        writeAll(fd, stats);
+    } else {
+        writeAll(fd, "error cannot optimize " + (TempInput.empty() ? inputfile : std::string("buffer")) + "\n");
+    }
+
+    if (!TempOutput.empty()) {
+        sys::fs::remove(TempInput);
+        sys::fs::remove(TempOutput);
+        sys::fs::remove(outputfile + ".stats");
+    }
+    return true;
 }
 
 
 /**
- * @brief Performs common subexpression elimination (CSE) on the given LLVM module.
- * 
- * This function iterates over all functions in the module and performs CSE
- * by identifying and eliminating common subexpressions within each function.
- * Common subexpressions are instructions that compute the same value and can
- * be replaced with a single instruction.
- * 
- * @param M Pointer to the LLVM module to perform CSE on.
+ * @brief Runs p2 as a daemon answering requests on a Unix domain socket.
+ *
+ * Command line parsing and LLVM's static initialization happen once for the
+ * life of the server, and requests share a warm LLVMContext. Named struct
+ * types are uniqued per context, so every request gives the type names of
+ * its module back before the next one is parsed, keeping the output the same
+ * as a standalone run. The context is replaced every ServerContextReuse
+ * requests, as types and constants are never freed while it lives.
+ *
+ * @param argv0 Program name used in diagnostics.
+ * @return 0 after a shutdown request, 1 if the socket could not be set up.
  */
-void performCSE(Module *M) {
-    DEBUG_PRINT("CSE start\n");
+static int runServer(const char *argv0) {
+    const unsigned ServerContextReuse = 64;
 
-    // Iterate over all functions in the module
-    for (Function &F : *M) {
-        if (!F.empty()) {
-            // Construct a dominator tree for the function
-            DominatorTree DT(F);
-            DT.recalculate(F);
-            std::vector<Instruction*> toEraseCSE;
-
-            // Iterate over all basic blocks in the function
-            for (BasicBlock &BB : F) {
-                // Iterate over all nodes in the dominator tree
-                for (DomTreeNodeBase<BasicBlock> *BBDomTreeNode : depth_first(DT.getRootNode())) {
-                    if (BBDomTreeNode) {
-                        BasicBlock *BBDomTree = BBDomTreeNode->getBlock();
-                        if (BBDomTree == &BB) { // same block
-                            // Iterate over all instructions in the basic block
-                            for (Instruction &I : BB) {
-                                // Iterate over all instructions in the same basic block of the dominator tree node
-                                for (Instruction &J : *BBDomTree) {
-                                    // Check if the instructions are different, I dominates J, and they literally match
-                                    if ((&I != &J) && DT.dominates(&I, &J) && isLiteralMatch(I, J)) {
-                                        DEBUG_PRINT("found CSE in the same block\n");
-                                        debugPrintLLVMInstr(J);
-                                        DEBUG_PRINT("\n");
-                                        // Replace J with I and add J to the list of instructions to erase
-                                        J.replaceAllUsesWith(&I);
-                                        toEraseCSE.push_back(&J);
-                                    }
-                                }
-                            }
-                        }
-                        // Check if the current basic block dominates the dominator tree node
-                        else if (DT.dominates(&BB, BBDomTree) && (&BB != BBDomTree)){ // different block and is dominated
-                            DEBUG_PRINT("BB dominates BBDomTree" << BBDomTree->getName() << "\n");
-                            // Iterate over all instructions in the basic block
-                            for (Instruction &I : BB) {
-                                // Iterate over all instructions in the dominated basic block of the dominator tree node
-                                for (Instruction &J : *BBDomTree) {
-                                    // Check if the instructions match as literals
-                                    if (isLiteralMatch(I, J)) {
-                                    // if (I.isIdenticalTo(&J)) {
-                                        DEBUG_PRINT("found CSE in the dominated block " << BBDomTree->getName() <<"\n");
-                                        debugPrintLLVMInstr(J);
-                                        DEBUG_PRINT("\n");
-                                        // Replace J with I and add J to the list of instructions to erase
-                                        J.replaceAllUsesWith(&I);
-                                        toEraseCSE.push_back(&J);
-                                    }
-                                }
-                            }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (ServerSocket.size() >= sizeof(addr.sun_path)) {
+        errs() << argv0 << ": socket path too long: " << ServerSocket << "\n";
+        return 1;
+    }
+    strncpy(addr.sun_path, ServerSocket.c_str(), sizeof(addr.sun_path) - 1);
+
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(addr.sun_path);
+    if (listenfd < 0 ||
+        bind(listenfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenfd, 16) < 0) {
+        errs() << argv0 << ": cannot listen on " << ServerSocket << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::unique_ptr<LLVMContext> Context = std::make_unique<LLVMContext>();
+    unsigned served = 0;
+    bool running = true;
+    while (running) {
+        int fd = accept(listenfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (served++ == ServerContextReuse) {
+            Context = std::make_unique<LLVMContext>();
+            served = 1;
+        }
+        running = serveRequest(fd, argv0, *Context);
+        ::close(fd);
+    }
+
+    ::close(listenfd);
+    ::unlink(addr.sun_path);
+    return 0;
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Result cache
+// --------------------------------------------------------------------------------
+// Part of every cache key and incremental fingerprint. Bump it whenever the
+// optimizations produce different output for the same input, so results of an
+// older p2 are not reused.
+static const char *const ResultsVersion = "14";
+
+/**
+ * @brief Computes the cache key for an input module under the current options.
+ *
+ * The key covers the input bytes, every option that changes the bitcode or
+ * the statistics, the LLVM version and ResultsVersion. -j and -verbose do not change either
+ * output and are left out. With -incremental-dir the statistics also depend
+ * on what the previous run recorded, so the incremental index is part of the key.
+ *
+ * @param input The contents of the input file.
+ * @param outputfile Path of the bitcode to write, names the incremental index.
+ * @return The hex encoded SHA1 of the key.
+ */
+static std::string computeCacheKey(const MemoryBuffer &input, const std::string &outputfile) {
+    SHA1 Hasher;
+    Hasher.update(std::string("p2-cache-v") + ResultsVersion + ";" LLVM_VERSION_STRING ";");
+    Hasher.update(Mem2Reg ? "mem2reg;" : ";");
+    Hasher.update(NoCSE ? "no-cse;" : ";");
+    Hasher.update(NoCheck ? "no;" : ";");
+    Hasher.update(MemSSALoads ? "memssa-loads;" : ";");
+    Hasher.update(AggressiveDCE ? "aggressive-dce;" : ";");
+    Hasher.update(InferAttrs ? "infer-attrs;" : ";");
+    Hasher.update(NoMathErrno ? "no-math-errno;" : ";");
+    if (!IncrementalDir.empty()) {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Index = MemoryBuffer::getFile(incrementalPath(outputfile, ".index"));
+        Hasher.update("incremental;");
+        Hasher.update(Index ? (*Index)->getBuffer() : StringRef());
+        Hasher.update(";");
+    }
+    Hasher.update(input.getBuffer());
+    return toHex(Hasher.final(), /*LowerCase=*/true);
+}
+
+
+/**
+ * @brief Returns the path of a cache entry.
+ *
+ * The llvmcache- prefix lets pruneCache manage the entries.
+ *
+ * @param key The cache key of the entry.
+ * @param ext The extension of the entry, .bc or .stats.
+ */
+static std::string cachePath(const std::string &key, StringRef ext) {
+    SmallString<128> Path(CacheDir);
+    sys::path::append(Path, "llvmcache-p2-" + key + ext);
+    return std::string(Path.str());
+}
+
+
+/**
+ * @brief Copies the cached bitcode and statistics for a key to the output.
+ *
+ * A missing half of an entry, for example one that is being evicted by
+ * another process, counts as a miss.
+ *
+ * @param key The cache key of the input.
+ * @param outputfile Path of the bitcode to write, the statistics go to outputfile.stats.
+ * @return true on a cache hit, false otherwise.
+ */
+static bool fetchFromCache(const std::string &key, const std::string &outputfile) {
+    std::string CachedBitcode = cachePath(key, ".bc");
+    std::string CachedStats = cachePath(key, ".stats");
+    if (!sys::fs::exists(CachedBitcode) || !sys::fs::exists(CachedStats)) {
+        return false;
+    }
+    if (sys::fs::copy_file(CachedStats, outputfile + ".stats") ||
+        sys::fs::copy_file(CachedBitcode, outputfile)) {
+        return false;
+    }
+
+    // Keep recently used entries away from eviction
+    for (const std::string &Path : {CachedBitcode, CachedStats}) {
+        int FD;
+        if (!sys::fs::openFileForWrite(Path, FD, sys::fs::CD_OpenExisting, sys::fs::OF_Append)) {
+            sys::fs::setLastAccessAndModificationTime(FD, std::chrono::system_clock::now());
+            sys::Process::SafelyCloseFileDescriptor(FD);
+        }
+    }
+
+    DEBUG_PRINT("cache hit " << key << "\n");
+    if (Verbose) {
+        errs() << "Statistics replayed from cache entry " << key << "\n";
+    }
+    return true;
+}
+
+
+/**
+ * @brief Atomically publishes a file into the cache directory.
+ *
+ * The copy is written to a unique temporary file next to its final name and
+ * renamed into place, so concurrent readers see either the whole file or none.
+ *
+ * @param from Path of the file to publish.
+ * @param to Final path in the cache directory.
+ * @return true if the file was published.
+ */
+static bool publishCacheFile(const std::string &from, const std::string &to) {
+    SmallString<128> TempPath;
+    int FD;
+    if (sys::fs::createUniqueFile(to + ".tmp-%%%%%%%%", FD, TempPath)) {
+        return false;
+    }
+    sys::Process::SafelyCloseFileDescriptor(FD);
+
+    if (sys::fs::copy_file(from, TempPath) || sys::fs::rename(TempPath, to)) {
+        sys::fs::remove(TempPath);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Stores the bitcode and statistics just written for a key in the cache.
+ *
+ * The statistics are published before the bitcode, which is what
+ * fetchFromCache checks first, and the directory is then pruned back under
+ * -cache-size.
+ *
+ * @param key The cache key of the input.
+ * @param outputfile Path of the bitcode that was written.
+ */
+static void storeInCache(const std::string &key, const std::string &outputfile) {
+    if (sys::fs::create_directories(CacheDir)) {
+        return;
+    }
+    if (!publishCacheFile(outputfile + ".stats", cachePath(key, ".stats")) ||
+        !publishCacheFile(outputfile, cachePath(key, ".bc"))) {
+        return;
+    }
+
+    CachePruningPolicy Policy;
+    Policy.Interval = std::chrono::seconds(0);
+    Policy.MaxSizeBytes = uint64_t(CacheSizeMB) * 1024 * 1024;
+    pruneCache(CacheDir, Policy);
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Incremental re-optimization
+// --------------------------------------------------------------------------------
+static llvm::Statistic CSEReused = {"", "CSEReused", "CSE functions reused from the previous run"};
+
+/**
+ * @brief Hashes a printed piece of IR.
+ *
+ * @param Text The IR text to be hashed.
+ * @return The hex encoded SHA1 of the text.
+ */
+static std::string hashIR(StringRef Text) {
+    SHA1 Hasher;
+    Hasher.update(Text);
+    return toHex(Hasher.final(), /*LowerCase=*/true);
+}
+
+
+/**
+ * @brief Computes the fingerprints of the module-level state and every function.
+ *
+ * The module hash covers everything a function's optimization can observe
+ * outside of its own body: the options, the data layout, the struct types and
+ * the global variables. Each function hash covers its printed IR, including
+ * the header and attributes that its callers see.
+ *
+ * @param M Reference to the LLVM module.
+ * @param FP Receives the fingerprints.
+ */
+static void computeFingerprints(Module &M, ModuleFingerprints &FP) {
+    std::string ModuleText;
+    raw_string_ostream MOS(ModuleText);
+    MOS << "p2-incremental-v" << ResultsVersion << ";" << (Mem2Reg ? "mem2reg;" : ";") << (NoCSE ? "no-cse;" : ";")
+        << (MemSSALoads ? "memssa-loads;" : ";") << (AggressiveDCE ? "aggressive-dce;" : ";")
+        << (InferAttrs ? "infer-attrs;" : ";") << (NoMathErrno ? "no-math-errno;" : ";") << M.getDataLayoutStr() << ";" << M.getTargetTriple() << "\n";
+    for (StructType *ST : M.getIdentifiedStructTypes()) {
+        MOS << ST->getName() << (ST->isPacked() ? " = <{" : " = {");
+        for (Type *ElementTy : ST->elements()) {
+            MOS << *ElementTy << ",";
+        }
+        MOS << (ST->isOpaque() ? " opaque\n" : "}\n");
+    }
+    for (GlobalVariable &GV : M.globals()) {
+        MOS << GV << "\n";
+    }
+    for (GlobalAlias &GA : M.aliases()) {
+        MOS << GA << "\n";
+    }
+    FP.ModuleHash = hashIR(MOS.str());
+
+    // One slot tracker for the whole module, so globals are numbered once and not per function
+    ModuleSlotTracker MST(&M);
+    for (Function &F : M) {
+        std::string FunctionText;
+        raw_string_ostream FOS(FunctionText);
+        static_cast<Value&>(F).print(FOS, MST);
+        FP.Functions[F.getName()] = hashIR(FOS.str());
+    }
+}
+
+
+/**
+ * @brief Returns the path of a file of the incremental state for an output.
+ *
+ * @param outputfile Path of the bitcode being written.
+ * @param ext The extension of the state file, .bc or .index.
+ */
+static std::string incrementalPath(const std::string &outputfile, StringRef ext) {
+    SmallString<128> Path(IncrementalDir);
+    sys::path::append(Path, sys::path::filename(outputfile) + ext);
+    return std::string(Path.str());
+}
+
+
+/**
+ * @brief Collects the functions whose result cannot be taken from the previous run.
+ *
+ * A function is stale if its own fingerprint changed, or if it references a
+ * stale function, since its optimization may depend on what is known about
+ * the callee.
+ *
+ * @param M Reference to the LLVM module being optimized.
+ * @param FP The fingerprints of this run.
+ * @param Prior The fingerprints of the previous run.
+ * @param Stale Receives the stale functions.
+ */
+static void collectStaleFunctions(Module &M, const ModuleFingerprints &FP, const StringMap<std::string> &Prior,
+                                  SmallPtrSetImpl<Function*> &Stale) {
+    std::vector<Function*> Worklist;
+    for (Function &F : M) {
+        auto It = Prior.find(F.getName());
+        if (It == Prior.end() || It->second != FP.Functions.lookup(F.getName())) {
+            Stale.insert(&F);
+            Worklist.push_back(&F);
+        }
+    }
+
+    // Everything that refers to a stale function, directly or through constants, is stale too
+    while (!Worklist.empty()) {
+        Function *Callee = Worklist.back();
+        Worklist.pop_back();
+
+        SmallVector<User*, 16> Users(Callee->users());
+        while (!Users.empty()) {
+            User *U = Users.pop_back_val();
+            if (Instruction *I = dyn_cast<Instruction>(U)) {
+                Function *Caller = I->getFunction();
+                if (Stale.insert(Caller).second) {
+                    Worklist.push_back(Caller);
+                }
+            } else if (isa<ConstantExpr>(U)) {
+                Users.append(U->user_begin(), U->user_end());
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Maps the types of the previous output onto the ones of this module.
+ *
+ * Identified structs are seeded by reusePriorResults, literal structs, arrays,
+ * vectors and function types are rebuilt around the mapped element types.
+ */
+struct PriorTypeRemapper : public ValueMapTypeRemapper {
+    DenseMap<Type*, Type*> Types;
+
+    Type *remapType(Type *SrcTy) override {
+        auto It = Types.find(SrcTy);
+        if (It != Types.end()) {
+            return It->second;
+        }
+
+        Type *Result = SrcTy;
+        if (ArrayType *AT = dyn_cast<ArrayType>(SrcTy)) {
+            Result = ArrayType::get(remapType(AT->getElementType()), AT->getNumElements());
+        } else if (VectorType *VT = dyn_cast<VectorType>(SrcTy)) {
+            Result = VectorType::get(remapType(VT->getElementType()), VT->getElementCount());
+        } else if (StructType *ST = dyn_cast<StructType>(SrcTy)) {
+            if (ST->isLiteral()) {
+                SmallVector<Type*, 8> Elements;
+                for (Type *ElementTy : ST->elements()) {
+                    Elements.push_back(remapType(ElementTy));
+                }
+                Result = StructType::get(ST->getContext(), Elements, ST->isPacked());
+            }
+        } else if (FunctionType *FT = dyn_cast<FunctionType>(SrcTy)) {
+            SmallVector<Type*, 8> Params;
+            for (Type *ParamTy : FT->params()) {
+                Params.push_back(remapType(ParamTy));
+            }
+            Result = FunctionType::get(remapType(FT->getReturnType()), Params, FT->isVarArg());
+        }
+        Types[SrcTy] = Result;
+        return Result;
+    }
+};
+
+
+/**
+ * @brief Maps the unnamed identified structs of the previous output by shape.
+ *
+ * Unnamed structs cannot be matched by name, so each one is matched to the
+ * single unnamed struct of this module with the same packing and mapped
+ * element types. Structs nested in each other are resolved over several
+ * rounds.
+ *
+ * @param PriorTypes The unnamed identified structs of the previous output.
+ * @param Types The unnamed identified structs of this module.
+ * @param TypeMapper The remapper to be seeded.
+ * @return true if every struct of the previous output found exactly one match.
+ */
+static bool mapUnnamedStructs(ArrayRef<StructType*> PriorTypes, ArrayRef<StructType*> Types,
+                              PriorTypeRemapper &TypeMapper) {
+    SmallVector<StructType*, 8> Pending(PriorTypes.begin(), PriorTypes.end());
+    bool Progress = true;
+    while (!Pending.empty() && Progress) {
+        Progress = false;
+        for (auto It = Pending.begin(); It != Pending.end();) {
+            StructType *PriorST = *It;
+            StructType *Match = nullptr;
+            unsigned Matches = 0;
+            for (StructType *ST : Types) {
+                if (ST->isPacked() != PriorST->isPacked() || ST->getNumElements() != PriorST->getNumElements()) {
+                    continue;
+                }
+                bool Same = true;
+                for (unsigned i = 0; i < ST->getNumElements() && Same; i++) {
+                    Type *PriorElementTy = PriorST->getElementType(i);
+                    auto Mapped = TypeMapper.Types.find(PriorElementTy);
+                    Same = (Mapped != TypeMapper.Types.end() ? Mapped->second : PriorElementTy) == ST->getElementType(i);
+                }
+                if (Same) {
+                    Match = ST;
+                    Matches++;
+                }
+            }
+            if (Matches == 1) {
+                TypeMapper.Types[PriorST] = Match;
+                It = Pending.erase(It);
+                Progress = true;
+            } else {
+                ++It;
+            }
+        }
+    }
+    return Pending.empty();
+}
+
+
+/**
+ * @brief Replaces the bodies of unchanged functions by their optimized bodies from the previous run.
+ *
+ * The previous output is parsed into the same context. Named struct types
+ * are uniqued per context, so the module's own types are unnamed while the
+ * previous output is read, which lets its types take their original names and
+ * be mapped back by name. Nothing is reused if the module-level fingerprint
+ * changed or a global of the previous output has no counterpart here.
+ *
+ * @param M Reference to the LLVM module being optimized.
+ * @param FP The fingerprints of the input of this run.
+ * @param outputfile Path of the bitcode being written.
+ * @param Reused Receives the functions whose body was taken from the previous run.
+ */
+static void reusePriorResults(Module &M, const ModuleFingerprints &FP, const std::string &outputfile,
+                              SmallPtrSetImpl<Function*> &Reused) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Index = MemoryBuffer::getFile(incrementalPath(outputfile, ".index"));
+    if (!Index) {
+        return;
+    }
+
+    // The index holds the module hash on its first line and then "<hash> <function name>" lines
+    SmallVector<StringRef, 256> Lines;
+    (*Index)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+    if (Lines.empty() || Lines[0] != "module " + FP.ModuleHash) {
+        return;
+    }
+    StringMap<std::string> Prior;
+    for (StringRef Line : llvm::drop_begin(Lines)) {
+        std::pair<StringRef, StringRef> Fields = Line.split(' ');
+        Prior[Fields.second] = Fields.first.str();
+    }
+
+    SmallPtrSet<Function*, 16> Stale;
+    collectStaleFunctions(M, FP, Prior, Stale);
+    if (Stale.size() == M.size()) {
+        return;
+    }
+
+    LLVMContext &Context = M.getContext();
+    bool HadDebugCU = M.getNamedMetadata("llvm.dbg.cu") != nullptr;
+    std::vector<std::pair<StructType*, std::string>> Names;
+    SmallVector<StructType*, 8> UnnamedTypes;
+    for (StructType *ST : M.getIdentifiedStructTypes()) {
+        if (ST->hasName()) {
+            Names.emplace_back(ST, ST->getName().str());
+            ST->setName("");
+        } else {
+            UnnamedTypes.push_back(ST);
+        }
+    }
+
+    {
+        SMDiagnostic Err;
+        std::unique_ptr<Module> PriorM = parseIRFile(incrementalPath(outputfile, ".bc"), Err, Context);
+
+        PriorTypeRemapper TypeMapper;
+        ValueToValueMapTy VMap;
+        bool Mappable = PriorM != nullptr;
+        if (Mappable) {
+            for (auto &Name : Names) {
+                if (StructType *ST = StructType::getTypeByName(Context, Name.second)) {
+                    TypeMapper.Types[ST] = Name.first;
+                }
+            }
+            SmallVector<StructType*, 8> PriorUnnamedTypes;
+            for (StructType *ST : PriorM->getIdentifiedStructTypes()) {
+                if (!ST->hasName()) {
+                    PriorUnnamedTypes.push_back(ST);
+                } else if (!TypeMapper.Types.count(ST)) {
+                    Mappable = false;
+                }
+            }
+            Mappable = Mappable && mapUnnamedStructs(PriorUnnamedTypes, UnnamedTypes, TypeMapper);
+        }
+        if (Mappable) {
+            for (GlobalValue &GV : PriorM->global_values()) {
+                GlobalValue *NewGV = GV.hasName() ? M.getNamedValue(GV.getName()) : nullptr;
+                if (!NewGV) {
+                    Mappable = false;
+                    break;
+                }
+                VMap[&GV] = NewGV;
+            }
+        }
+
+        for (Function &F : M) {
+            if (!Mappable || F.isDeclaration() || Stale.count(&F)) {
+                continue;
+            }
+            Function *PriorF = PriorM->getFunction(F.getName());
+            if (!PriorF || PriorF->isDeclaration() || PriorF->arg_size() != F.arg_size()) {
+                continue;
+            }
+
+            // Attributes such as byval carry types, keep this module's own header
+            AttributeList Attrs = F.getAttributes();
+            F.dropAllReferences();
+            for (auto Args : llvm::zip(PriorF->args(), F.args())) {
+                VMap[&std::get<0>(Args)] = &std::get<1>(Args);
+            }
+            SmallVector<ReturnInst*, 8> Returns;
+            CloneFunctionInto(&F, PriorF, VMap, CloneFunctionChangeType::DifferentModule, Returns,
+                              "", nullptr, &TypeMapper);
+            F.setAttributes(Attrs);
+            Reused.insert(&F);
+            CSEReused++;
+        }
+    }
+
+    // Cloning into another module registers compile units even when there are none
+    NamedMDNode *DebugCU = M.getNamedMetadata("llvm.dbg.cu");
+    if (!HadDebugCU && DebugCU && DebugCU->getNumOperands() == 0) {
+        DebugCU->eraseFromParent();
+    }
+
+    // The previous output is gone, give the module its type names back
+    for (auto &Name : Names) {
+        if (StructType *ST = StructType::getTypeByName(Context, Name.second)) {
+            ST->setName("");
+        }
+        Name.first->setName(Name.second);
+    }
+}
+
+
+/**
+ * @brief Records the output of this run as the baseline for the next one.
+ *
+ * @param FP The fingerprints of the input of this run.
+ * @param outputfile Path of the bitcode that was written.
+ */
+static void savePriorResults(const ModuleFingerprints &FP, const std::string &outputfile) {
+    if (sys::fs::create_directories(IncrementalDir)) {
+        return;
+    }
+
+    std::string IndexText = "module " + FP.ModuleHash + "\n";
+    for (const auto &Entry : FP.Functions) {
+        IndexText += Entry.getValue() + " " + Entry.getKey().str() + "\n";
+    }
+
+    // Publish the bitcode first, a new index never points at an old body
+    std::string TempIndex = incrementalPath(outputfile, ".index.new");
+    {
+        std::ofstream index(TempIndex);
+        index << IndexText;
+    }
+    if (!publishCacheFile(outputfile, incrementalPath(outputfile, ".bc")) ||
+        sys::fs::rename(TempIndex, incrementalPath(outputfile, ".index"))) {
+        sys::fs::remove(TempIndex);
+    }
+}
+
+
+/**
+ * @brief Records a cached output as the baseline for the next incremental run.
+ *
+ * A cache hit skips the optimizations, but the next run must still see the
+ * fingerprints of this input, so the input is parsed just to compute them.
+ *
+ * @param input The contents of the input file.
+ * @param outputfile Path of the bitcode that was copied from the cache.
+ * @param argv0 Program name used in diagnostics.
+ * @param Context The LLVMContext to parse the input in.
+ * @return 0 on success, 1 if the input could not be read.
+ */
+static int saveCachedPriorResults(const MemoryBuffer &input, const std::string &outputfile, const char *argv0,
+                                  LLVMContext &Context) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIR(input.getMemBufferRef(), Err, Context);
+    if (!M) {
+        Err.print(argv0, errs());
+        return 1;
+    }
+
+    ModuleFingerprints Fingerprints;
+    computeFingerprints(*M, Fingerprints);
+    savePriorResults(Fingerprints, outputfile);
+
+    // A server parses the next module into the same context
+    if (!ServerSocket.empty()) {
+        for (StructType *ST : M->getIdentifiedStructTypes()) {
+            ST->setName("");
+        }
+    }
+    return 0;
+}
+
+
+static llvm::Statistic nFunctions = {"", "Functions", "number of functions"};
+static llvm::Statistic nInstructions = {"", "Instructions", "number of instructions"};
+static llvm::Statistic nLoads = {"", "Loads", "number of loads"};
+static llvm::Statistic nStores = {"", "Stores", "number of stores"};
+
+static void summarize(Module *M) {
+    for (auto i = M->begin(); i != M->end(); i++) {
+        if (i->begin() != i->end()) {
+            nFunctions++;
+        }
+
+        for (auto j = i->begin(); j != i->end(); j++) {
+            for (auto k = j->begin(); k != j->end(); k++) {
+                Instruction &I = *k;
+                nInstructions++;
+                if (isa<LoadInst>(&I)) {
+                    nLoads++;
+                } else if (isa<StoreInst>(&I)) {
+                    nStores++;
+                }
+            }
+        }
+    }
+}
+
+static void print_csv_file(std::string outputfile)
+{
+    std::ofstream stats(outputfile + ".stats");
+    auto a = GetStatistics();
+    // Statistics register on first use, sort them so the file does not depend on thread timing
+    std::sort(a.begin(), a.end());
+    for (auto p : a) {
+        stats << p.first.str() << "," << p.second << std::endl;
+    }
+    stats.close();
+}
+#endif // P2_PLUGIN
+
+static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
+static llvm::Statistic CSEDeadBlock = {"", "CSEDeadBlock", "CSE removed unreachable blocks"};
+static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
+static llvm::Statistic CSESimplify = {"", "CSESimplify", "CSE simplified instructions"};
+static llvm::Statistic CSEReassoc = {"", "CSEReassoc", "CSE reassociated expression trees"};
+static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
+static llvm::Statistic CSEStore2Load = {"", "CSEStore2Load", "CSE forwarded store to load"};
+static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+
+// --------------------------------------------------------------------------------
+//                      Worklist shared by all optimizations
+// --------------------------------------------------------------------------------
+/**
+ * @brief Tracks the instructions of a function that still have to be visited.
+ *
+ * The optimizations only look at the instructions (and, for the memory
+ * optimizations, the blocks) queued for the current sweep. Every RAUW and
+ * erase goes through replaceInstruction/eraseInstruction, which queue the
+ * affected users and operands for the next sweep, so a function is swept
+ * again only as long as something in it keeps changing.
+ */
+class CSEWorklist {
+public:
+    /**
+     * @brief Queues every instruction of the function for the first sweep.
+     *
+     * @param F Reference to the LLVM function to be optimized.
+     */
+    void seed(Function &F) {
+        for (BasicBlock &BB : F) {
+            CurrentBlocks.insert(&BB);
+            for (Instruction &I : BB) {
+                Current.insert(&I);
+            }
+        }
+    }
+
+    /**
+     * @brief Queues the value for the next sweep if it is an instruction.
+     *
+     * @param V Pointer to the LLVM value to be queued.
+     */
+    void push(Value *V) {
+        if (Instruction *I = dyn_cast<Instruction>(V)) {
+            Next.insert(I);
+            NextBlocks.insert(I->getParent());
+        }
+    }
+
+    /**
+     * @brief Queues all instructions using the value for the next sweep.
+     *
+     * @param V Pointer to the LLVM value whose users are queued.
+     */
+    void pushUsers(Value *V) {
+        for (User *U : V->users()) {
+            push(U);
+        }
+    }
+
+    /**
+     * @brief Queues all instructions the given instruction uses for the next sweep.
+     *
+     * @param I Pointer to the LLVM instruction whose operands are queued.
+     */
+    void pushOperands(Instruction *I) {
+        for (Value *Op : I->operands()) {
+            push(Op);
+        }
+    }
+
+    /**
+     * @brief Queues the block for the next sweep of the memory optimizations.
+     *
+     * @param BB Pointer to the basic block to be queued.
+     */
+    void pushBlock(BasicBlock *BB) {
+        NextBlocks.insert(BB);
+    }
+
+    /**
+     * @brief Drops an instruction that is about to be erased from both sweeps.
+     *
+     * @param I Pointer to the LLVM instruction to be forgotten.
+     */
+    void forget(Instruction *I) {
+        Current.erase(I);
+        Next.erase(I);
+    }
+
+    /**
+     * @brief Drops a block that is about to be deleted, and all of its instructions, from both sweeps.
+     *
+     * @param BB Pointer to the basic block to be forgotten.
+     */
+    void forget(BasicBlock *BB) {
+        for (Instruction &I : *BB) {
+            forget(&I);
+        }
+        CurrentBlocks.erase(BB);
+        NextBlocks.erase(BB);
+    }
+
+    bool isQueued(Instruction *I) const { return Current.count(I); }
+    bool isQueued(BasicBlock *BB) const { return CurrentBlocks.count(BB); }
+
+    /**
+     * @brief Records that an instruction of the function was replaced or erased.
+     */
+    void noteChange() { Changed = true; }
+    bool madeChanges() const { return Changed; }
+
+    /**
+     * @brief Keeps the given MemorySSA in sync with the instructions erased from now on.
+     *
+     * @param Updater Pointer to the updater of the function's MemorySSA.
+     */
+    void setMemorySSAUpdater(MemorySSAUpdater *Updater) { MSSAU = Updater; }
+    MemorySSAUpdater *getMemorySSAUpdater() const { return MSSAU; }
+
+    /**
+     * @brief Checks if anything was queued for the next sweep so far.
+     */
+    bool hasNext() const { return !Next.empty() || !NextBlocks.empty(); }
+
+    /**
+     * @brief Moves the work queued during this sweep to the current sweep.
+     *
+     * @return true if there is anything left to visit, false otherwise.
+     */
+    bool advance() {
+        Current.swap(Next);
+        CurrentBlocks.swap(NextBlocks);
+        Next.clear();
+        NextBlocks.clear();
+        return !Current.empty() || !CurrentBlocks.empty();
+    }
+
+private:
+    SmallPtrSet<Instruction*, 32> Current;
+    SmallPtrSet<Instruction*, 32> Next;
+    SmallPtrSet<BasicBlock*, 8> CurrentBlocks;
+    SmallPtrSet<BasicBlock*, 8> NextBlocks;
+    bool Changed = false;
+    MemorySSAUpdater *MSSAU = nullptr;
+};
+
+/**
+ * @brief Serializes every change to the IR when functions are optimized in parallel.
+ *
+ * Constants and globals are shared by all functions of the LLVMContext, and
+ * their use lists change whenever an instruction using them is replaced or
+ * erased. The LLVMContext also keeps every value handle in one shared table,
+ * so handles are created and destroyed under the lock too. Everything else
+ * the optimizations do (scanning, hashing, dominator trees) only reads the
+ * function being optimized and runs unlocked. The one shared cache they read,
+ * the struct layouts of the data layout, is filled before the threads start.
+ */
+static std::mutex ContextMutex;
+
+
+/**
+ * @brief Caches the CSE fingerprint of every instruction of a function.
+ *
+ * A fingerprint hashes the opcode, type, predicate and operands of an
+ * instruction, the fields two equivalent instructions share, so most pairs of
+ * instructions are told apart by comparing two integers. The operands of
+ * commutative operations and compares are hashed in pointer order, with the
+ * predicate swapped to match, so add a, b and add b, a share a fingerprint. Fingerprints are
+ * computed once and kept across optimizations and sweeps. Value handles keep
+ * them valid: every fingerprinted instruction and every instruction it uses
+ * is watched, and when a watched instruction is replaced, the fingerprints of
+ * its users are recomputed on their next use. PHIs whose incoming values are
+ * dropped are marked through invalidatePHIs().
+ */
+class CSEFingerprintCache {
+public:
+    CSEFingerprintCache() = default;
+    CSEFingerprintCache(const CSEFingerprintCache &) = delete;
+    CSEFingerprintCache &operator=(const CSEFingerprintCache &) = delete;
+
+    ~CSEFingerprintCache() {
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        Entries.clear();
+    }
+
+    /**
+     * @brief Returns the fingerprint of an instruction, computing it if needed.
+     *
+     * @param I Pointer to the LLVM instruction.
+     * @return The fingerprint of the instruction.
+     */
+    unsigned get(Instruction *I) {
+        auto It = Entries.find(I);
+        if (It != Entries.end() && It->second.Valid) {
+            return It->second.Hash;
+        }
+
+        hash_code Hash = hash_combine(I->getOpcode(), I->getType());
+        if (CmpInst *CI = dyn_cast<CmpInst>(I)) {
+            // Hash the form with the lower operand first, swapping the predicate along
+            Value *LHS = CI->getOperand(0);
+            Value *RHS = CI->getOperand(1);
+            CmpInst::Predicate Pred = CI->getPredicate();
+            if (std::less<Value*>()(RHS, LHS)) {
+                std::swap(LHS, RHS);
+                Pred = CI->getSwappedPredicate();
+            }
+            Hash = hash_combine(Hash, Pred, LHS, RHS);
+        } else if (isa<BinaryOperator>(I) && I->isCommutative()) {
+            Value *LHS = I->getOperand(0);
+            Value *RHS = I->getOperand(1);
+            if (std::less<Value*>()(RHS, LHS)) {
+                std::swap(LHS, RHS);
+            }
+            Hash = hash_combine(Hash, LHS, RHS);
+        } else {
+            Hash = hash_combine(Hash, hash_combine_range(I->value_op_begin(), I->value_op_end()));
+        }
+
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        for (Value *Op : I->operands()) {
+            if (isa<Instruction>(Op)) {
+                watch(Op);
+            }
+        }
+        // Taken last, watching may grow the map and move the entries
+        Entry &E = watch(I);
+        E.Hash = Hash;
+        E.Valid = true;
+        return E.Hash;
+    }
+
+    /**
+     * @brief Marks the fingerprints of all PHIs stale.
+     *
+     * Removing a predecessor drops the incoming values of its PHIs in place,
+     * which no value handle sees.
+     */
+    void invalidatePHIs() {
+        for (auto &E : Entries) {
+            if (isa<PHINode>(E.first)) {
+                E.second.Valid = false;
+            }
+        }
+    }
+
+private:
+    /**
+     * @brief Drops the cached entries when the watched instruction changes.
+     */
+    class Handle final : public CallbackVH {
+    public:
+        Handle(Value *V, CSEFingerprintCache *Cache) : CallbackVH(V), Cache(Cache) {}
+
+        void deleted() override {
+            // Destroys this handle, nothing may touch it afterwards
+            Cache->Entries.erase(getValPtr());
+        }
+
+        void allUsesReplacedWith(Value *) override {
+            // Called before the uses move, so these are the users whose operands change
+            for (User *U : getValPtr()->users()) {
+                auto It = Cache->Entries.find(U);
+                if (It != Cache->Entries.end()) {
+                    It->second.Valid = false;
+                }
+            }
+        }
+
+    private:
+        CSEFingerprintCache *Cache;
+    };
+
+    struct Entry {
+        Entry(Value *V, CSEFingerprintCache *Cache) : H(V, Cache) {}
+        Handle H;
+        unsigned Hash = 0;
+        bool Valid = false;
+    };
+
+    Entry &watch(Value *V) {
+        return Entries.try_emplace(V, V, this).first->second;
+    }
+
+    DenseMap<Value*, Entry> Entries;
+};
+
+
+/**
+ * @brief Caches the analyses of a function across optimizations and sweeps.
+ *
+ * The dominator tree is built the first time an optimization asks for it and
+ * stays valid for as long as the CFG does. An optimization that changes the
+ * CFG reports its edge updates through getDomTreeUpdater(), which applies them
+ * lazily the next time the tree is requested, and then calls noteCFGChange()
+ * so the analyses that cannot follow are dropped. Further analyses (LoopInfo,
+ * MemorySSA, ...) belong here as well, next to the dominator tree they are
+ * built from.
+ *
+ * One instance exists per function being optimized, so functions optimized in
+ * parallel never share one. The p2 tool builds every analysis here, while
+ * inside opt they all come from the pass manager, and updates made through
+ * this cache keep its dominator tree valid as well. Flushing the updater
+ * finally deletes the removed blocks, and the assumption cache holds value
+ * handles, so both happen under ContextMutex.
+ */
+class CSEAnalyses {
+public:
+    CSEAnalyses(Function &F, const TargetLibraryInfoImpl &TLII) : F(F), TLII(&TLII) {}
+    CSEAnalyses(Function &F, FunctionAnalysisManager &FAM) : F(F), FAM(&FAM) {}
+    CSEAnalyses(const CSEAnalyses &) = delete;
+    CSEAnalyses &operator=(const CSEAnalyses &) = delete;
+
+    ~CSEAnalyses() {
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        MSSAU.reset();
+        OwnedMSSA.reset();
+        OwnedAA.reset();
+        TypeBasedAA.reset();
+        ScopedNoAliasAA.reset();
+        BasicAA.reset();
+        OwnedAC.reset();
+        DTU.reset();
+    }
+
+    /**
+     * @brief Returns the dominator tree of the function, building it if needed.
+     *
+     * @return Reference to the up to date dominator tree.
+     */
+    DominatorTree &getDomTree() {
+        if (DTU) {
+            // Applying the pending updates deletes the blocks they removed
+            std::lock_guard<std::mutex> Lock(ContextMutex);
+            return DTU->getDomTree();
+        }
+        if (!DT) {
+            if (FAM) {
+                DT = &FAM->getResult<DominatorTreeAnalysis>(F);
+            } else {
+                OwnedDT = std::make_unique<DominatorTree>(F);
+                DT = OwnedDT.get();
+            }
+        }
+        return *DT;
+    }
+
+    /**
+     * @brief Returns the updater through which CFG changes are reported.
+     *
+     * @return Reference to a lazy updater of the cached dominator tree.
+     */
+    DomTreeUpdater &getDomTreeUpdater() {
+        if (!DTU) {
+            DTU = std::make_unique<DomTreeUpdater>(getDomTree(), DomTreeUpdater::UpdateStrategy::Lazy);
+        }
+        return *DTU;
+    }
+
+    /**
+     * @brief Returns the target library info of the function, building it if needed.
+     *
+     * Only the function's own overrides are built here, the library info of
+     * the target is built once per module and only read.
+     *
+     * @return Reference to the library info for the module's target triple.
+     */
+    TargetLibraryInfo &getTLI() {
+        if (!TLI) {
+            if (FAM) {
+                TLI = &FAM->getResult<TargetLibraryAnalysis>(F);
+            } else {
+                OwnedTLI = std::make_unique<TargetLibraryInfo>(*TLII, &F);
+                TLI = OwnedTLI.get();
+            }
+        }
+        return *TLI;
+    }
+
+    /**
+     * @brief Returns the assumption cache of the function, building it if needed.
+     *
+     * The function is scanned for assumptions right away, under ContextMutex,
+     * as scanning creates value handles. Later queries only read the cache.
+     *
+     * @return Reference to the assumption cache.
+     */
+    AssumptionCache &getAssumptionCache() {
+        if (!AC) {
+            if (FAM) {
+                AC = &FAM->getResult<AssumptionAnalysis>(F);
+            } else {
+                OwnedAC = std::make_unique<AssumptionCache>(F);
+                AC = OwnedAC.get();
+                std::lock_guard<std::mutex> Lock(ContextMutex);
+                // Only for the scan, a lazy one would create its handles unlocked on the first query
+                (void)AC->assumptions();
+            }
+        }
+        return *AC;
+    }
+
+    /**
+     * @brief Returns a simplification query that can use every analysis of the function.
+     *
+     * @return The query, to be narrowed to an instruction with getWithInstruction().
+     */
+    SimplifyQuery getSimplifyQuery() {
+        return SimplifyQuery(F.getParent()->getDataLayout(), &getTLI(), &getDomTree(), &getAssumptionCache());
+    }
+
+    /**
+     * @brief Returns the alias analysis of the function, building it if needed.
+     *
+     * The stack built here queries BasicAA first, then the scoped noalias and
+     * TBAA metadata, and answers with the most precise result any of them
+     * gives. Inside opt the pipeline's own AA stack is used instead.
+     *
+     * @return Reference to the alias analysis results.
+     */
+    AAResults &getAAResults() {
+        if (!AA) {
+            if (FAM) {
+                AA = &FAM->getResult<AAManager>(F);
+                return *AA;
+            }
+            BasicAA = std::make_unique<BasicAAResult>(F.getParent()->getDataLayout(), F, getTLI(),
+                                                      getAssumptionCache(), &getDomTree());
+            ScopedNoAliasAA = std::make_unique<ScopedNoAliasAAResult>();
+            TypeBasedAA = std::make_unique<TypeBasedAAResult>();
+            OwnedAA = std::make_unique<AAResults>(getTLI());
+            OwnedAA->addAAResult(*BasicAA);
+            OwnedAA->addAAResult(*ScopedNoAliasAA);
+            OwnedAA->addAAResult(*TypeBasedAA);
+            AA = OwnedAA.get();
+        }
+        return *AA;
+    }
+
+    /**
+     * @brief Returns the MemorySSA of the function, building it if needed.
+     *
+     * Instructions erased while the updater is registered with the worklist
+     * are removed from it, so it stays valid across sweeps.
+     *
+     * @return Reference to the MemorySSA of the function.
+     */
+    MemorySSA &getMemorySSA() {
+        if (!MSSA) {
+            // The pass manager's MemorySSA is built on its dominator tree, which must be up to date first
+            DominatorTree &Tree = getDomTree();
+            if (FAM) {
+                MSSA = &FAM->getResult<MemorySSAAnalysis>(F).getMSSA();
+            } else {
+                OwnedMSSA = std::make_unique<MemorySSA>(F, &getAAResults(), &Tree);
+                MSSA = OwnedMSSA.get();
+            }
+            MSSAU = std::make_unique<MemorySSAUpdater>(MSSA);
+        }
+        return *MSSA;
+    }
+
+    MemorySSAUpdater &getMemorySSAUpdater() {
+        getMemorySSA();
+        return *MSSAU;
+    }
+
+    /**
+     * @brief Drops the MemorySSA, so it is built again the next time it is asked for.
+     *
+     * Inside opt the pass manager's MemorySSA is invalidated as well, as it
+     * may have been computed before the changes that made it stale.
+     */
+    void invalidateMemorySSA() {
+        MSSAU.reset();
+        OwnedMSSA.reset();
+        MSSA = nullptr;
+        if (FAM) {
+            PreservedAnalyses PA = PreservedAnalyses::all();
+            PA.abandon<MemorySSAAnalysis>();
+            FAM->invalidate(F, PA);
+        }
+    }
+
+    CSEFingerprintCache &getFingerprints() {
+        return Fingerprints;
+    }
+
+    /**
+     * @brief Records that edges or blocks were removed through getDomTreeUpdater().
+     *
+     * The dominator tree follows the updates, but MemorySSA does not, so it is
+     * built again the next time it is asked for. The PHIs of the successors
+     * lose incoming values, so their fingerprints are recomputed as well.
+     */
+    void noteCFGChange() {
+        CFGChanged = true;
+        invalidateMemorySSA();
+        Fingerprints.invalidatePHIs();
+    }
+    bool changedCFG() const { return CFGChanged; }
+
+private:
+    Function &F;
+    const TargetLibraryInfoImpl *TLII = nullptr;
+    // Set inside opt, where every analysis is taken from the pass manager
+    FunctionAnalysisManager *FAM = nullptr;
+    DominatorTree *DT = nullptr;
+    std::unique_ptr<DominatorTree> OwnedDT;
+    std::unique_ptr<DomTreeUpdater> DTU;  // must be destroyed before OwnedDT
+    TargetLibraryInfo *TLI = nullptr;
+    std::unique_ptr<TargetLibraryInfo> OwnedTLI;
+    AssumptionCache *AC = nullptr;
+    std::unique_ptr<AssumptionCache> OwnedAC;
+    // Built on top of the analyses above, so destroyed before them
+    std::unique_ptr<BasicAAResult> BasicAA;
+    std::unique_ptr<ScopedNoAliasAAResult> ScopedNoAliasAA;
+    std::unique_ptr<TypeBasedAAResult> TypeBasedAA;
+    AAResults *AA = nullptr;
+    std::unique_ptr<AAResults> OwnedAA;
+    MemorySSA *MSSA = nullptr;
+    std::unique_ptr<MemorySSA> OwnedMSSA;
+    std::unique_ptr<MemorySSAUpdater> MSSAU;
+    CSEFingerprintCache Fingerprints;
+    bool CFGChanged = false;
+};
+
+
+/**
+ * @brief Replaces all uses of an instruction and queues its users, for a caller holding ContextMutex.
+ *
+ * @param I Pointer to the LLVM instruction being replaced.
+ * @param V Pointer to the LLVM value replacing it.
+ * @param WL The worklist of the function being optimized.
+ */
+static void replaceInstructionLocked(Instruction *I, Value *V, CSEWorklist &WL) {
+    WL.pushUsers(I);
+    WL.noteChange();
+    I->replaceAllUsesWith(V);
+}
+
+
+/**
+ * @brief Replaces all uses of an instruction and queues its users.
+ *
+ * @param I Pointer to the LLVM instruction being replaced.
+ * @param V Pointer to the LLVM value replacing it.
+ * @param WL The worklist of the function being optimized.
+ */
+static void replaceInstruction(Instruction *I, Value *V, CSEWorklist &WL) {
+    std::lock_guard<std::mutex> Lock(ContextMutex);
+    replaceInstructionLocked(I, V, WL);
+}
+
+
+/**
+ * @brief Erases an instruction and queues the instructions it used.
+ *
+ * Erasing a load or store also changes what the memory optimizations see in
+ * the block, so the block is queued as well, and MemorySSA drops its access if
+ * the worklist keeps one up to date.
+ *
+ * @param I Pointer to the LLVM instruction to be erased.
+ * @param WL The worklist of the function being optimized.
+ */
+static void eraseInstruction(Instruction *I, CSEWorklist &WL) {
+    WL.pushOperands(I);
+    if (I->mayReadOrWriteMemory()) {
+        WL.pushBlock(I->getParent());
+    }
+    WL.forget(I);
+    WL.noteChange();
+    if (MemorySSAUpdater *MSSAU = WL.getMemorySSAUpdater()) {
+        MSSAU->removeMemoryAccess(I);
+    }
+    std::lock_guard<std::mutex> Lock(ContextMutex);
+    I->eraseFromParent();
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Optimization 0: Dead Code Elimination
+// --------------------------------------------------------------------------------
+/**
+ * @brief Checks if the given LLVM instruction is dead, i.e., has no uses and can be safely removed.
+ * 
+ * An instruction without uses is dead when removing it cannot be observed,
+ * which is what wouldInstructionBeTriviallyDead decides: arithmetic, casts,
+ * comparisons, allocas, PHIs and non-volatile loads, but also calls and
+ * intrinsics that do not write memory, always return and cannot throw.
+ * Stores, terminators, volatile or ordered accesses and calls with side
+ * effects are never dead.
+ * 
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return True if the instruction is dead, false otherwise.
+ */
+bool isDead(Instruction &I) { 
+    // Check if the instruction has no uses
+    if (!I.use_empty()) {
+        return false;
+    }
+    return wouldInstructionBeTriviallyDead(&I);
+}
+
+
+/**
+ * @brief Performs dead code elimination (DCE) on the given LLVM function.
+ * 
+ * The dead instructions among the ones queued in the worklist seed a list of
+ * instructions to erase. Erasing an instruction may leave one of its operands
+ * without uses, and such an operand is added to the list right away, so a
+ * whole chain of dead instructions is removed in one call, each instruction
+ * being looked at once per use it loses.
+ * 
+ * @param F Reference to the LLVM function to perform DCE on.
+ * @param WL The worklist of the function being optimized.
+ */
+static void DeadCodeElimination(Function &F, CSEWorklist &WL) {
+    DEBUG_PRINT("DCE start\n");
+
+    // Collect the queued instructions that are dead
+    SmallSetVector<Instruction*, 16> deadInstList;
+    for (BasicBlock &BB : F) {
+        for (Instruction &I : BB) {
+            if (WL.isQueued(&I) && isDead(I)) {
+                deadInstList.insert(&I);
+            }
+        }
+    }
+
+    // Remove dead instructions, following the operands they leave dead
+    while (!deadInstList.empty()) {
+        Instruction *deadInst = deadInstList.pop_back_val();
+        SmallVector<Instruction*, 4> operands;
+        for (Value *Op : deadInst->operands()) {
+            if (Instruction *OpI = dyn_cast<Instruction>(Op)) {
+                operands.push_back(OpI);
+            }
+        }
+
+        DEBUG_PRINT("erasing dead instruction: \n\t");
+        debugPrintLLVMInstr(*deadInst);
+        DEBUG_PRINT("\n");
+        eraseInstruction(deadInst, WL);
+        CSEDead++;
+
+        for (Instruction *OpI : operands) {
+            if (isDead(*OpI)) {
+                deadInstList.insert(OpI);
+            }
+        }
+    }
+
+    DEBUG_PRINT("DCE end\n");
+}
+
+
+/**
+ * @brief Performs liveness based dead code elimination on the given LLVM function (-aggressive-dce).
+ * 
+ * Conditional branches on a constant, or to the same block twice, are first
+ * turned into unconditional branches, and the blocks no longer reachable from
+ * the entry block are deleted. Then every instruction with an effect that can
+ * be observed (stores, calls with side effects, terminators, ...) is marked
+ * live, and so, transitively, is every instruction it uses. The instructions
+ * left unmarked are dead even when they still have uses, like PHI nodes of a
+ * loop that only feed each other, and are removed.
+ * 
+ * Branches always stay live. Removing a branch whose targets compute nothing
+ * would need post-dominance, which none of the other optimizations use.
+ * 
+ * @param F Reference to the LLVM function to perform DCE on.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function, updated as the CFG changes.
+ */
+static void AggressiveDeadCodeElimination(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Aggressive DCE start\n");
+
+    DomTreeUpdater &DTU = AM.getDomTreeUpdater();
+
+    // Fold the branches that can only go one way
+    for (BasicBlock &BB : F) {
+        BranchInst *BI = dyn_cast<BranchInst>(BB.getTerminator());
+        if (BI == nullptr || !BI->isConditional()) {
+            continue;
+        }
+        BasicBlock *Taken = BI->getSuccessor(0);
+        BasicBlock *NotTaken = BI->getSuccessor(1);
+        if (ConstantInt *Cond = dyn_cast<ConstantInt>(BI->getCondition())) {
+            if (Cond->isZero()) {
+                std::swap(Taken, NotTaken);
+            }
+        } else if (Taken != NotTaken) {
+            continue;
+        }
+
+        DEBUG_PRINT("folding branch: \n\t");
+        debugPrintLLVMInstr(*BI);
+        DEBUG_PRINT("\n");
+        WL.setMemorySSAUpdater(nullptr);
+        AM.noteCFGChange();
+        {
+            // Keep single entry PHIs, SimplifyInstructions replaces them through the worklist
+            std::lock_guard<std::mutex> Lock(ContextMutex);
+            NotTaken->removePredecessor(&BB, /*KeepOneInputPHIs=*/true);
+            for (PHINode &PN : NotTaken->phis()) {
+                WL.push(&PN);
+            }
+            // With both edges to the same block only its second PHI entry for BB goes, the edge stays
+            if (Taken != NotTaken) {
+                DTU.applyUpdates({{DominatorTree::Delete, &BB, NotTaken}});
+            }
+        }
+        BranchInst::Create(Taken, BI);
+        eraseInstruction(BI, WL);
+    }
+
+    // Delete the blocks that can no longer be reached
+    df_iterator_default_set<BasicBlock*> Reachable;
+    for (BasicBlock *BB : depth_first_ext(&F, Reachable)) {
+        (void)BB;
+    }
+    SmallVector<BasicBlock*, 8> deadBlockList;
+    for (BasicBlock &BB : F) {
+        if (!Reachable.count(&BB)) {
+            deadBlockList.push_back(&BB);
+        }
+    }
+    if (deadBlockList.size() > 0) {
+        WL.setMemorySSAUpdater(nullptr);
+        AM.noteCFGChange();
+        for (BasicBlock *deadBlock : deadBlockList) {
+            DEBUG_PRINT("erasing unreachable block: " << deadBlock->getName() << "\n");
+            WL.forget(deadBlock);
+            for (BasicBlock *Succ : successors(deadBlock)) {
+                for (PHINode &PN : Succ->phis()) {
+                    WL.push(&PN);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        DeleteDeadBlocks(deadBlockList, &DTU, /*KeepOneInputPHIs=*/true);
+        WL.noteChange();
+        CSEDeadBlock += deadBlockList.size();
+    }
+
+    // Mark the instructions with observable effects live, then everything they use
+    SmallPtrSet<Instruction*, 32> Live;
+    SmallVector<Instruction*, 128> liveInstList;
+    for (Instruction &I : instructions(F)) {
+        if (!isa<DbgInfoIntrinsic>(I) && !wouldInstructionBeTriviallyDead(&I)) {
+            Live.insert(&I);
+            liveInstList.push_back(&I);
+        }
+    }
+    while (!liveInstList.empty()) {
+        Instruction *I = liveInstList.pop_back_val();
+        for (Value *Op : I->operands()) {
+            Instruction *OpI = dyn_cast<Instruction>(Op);
+            if (OpI != nullptr && Live.insert(OpI).second) {
+                liveInstList.push_back(OpI);
+            }
+        }
+    }
+
+    // Debug intrinsics are kept, erasing the value they describe turns it into undef
+    std::vector<Instruction*> deadInstList;
+    for (Instruction &I : instructions(F)) {
+        if (!isa<DbgInfoIntrinsic>(I) && !Live.count(&I)) {
+            deadInstList.push_back(&I);
+        }
+    }
+
+    // Dead instructions may use each other in cycles, and only dead instructions use them
+    for (Instruction *deadInst : deadInstList) {
+        if (!deadInst->use_empty()) {
+            std::lock_guard<std::mutex> Lock(ContextMutex);
+            deadInst->replaceAllUsesWith(PoisonValue::get(deadInst->getType()));
+        }
+    }
+    for (Instruction *deadInst : deadInstList) {
+        DEBUG_PRINT("erasing dead instruction: \n\t");
+        debugPrintLLVMInstr(*deadInst);
+        DEBUG_PRINT("\n");
+        eraseInstruction(deadInst, WL);
+        CSEDead++;
+    }
+
+    DEBUG_PRINT("Aggressive DCE end\n");
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Optimization 1: Simplify Instructions
+// --------------------------------------------------------------------------------
+/**
+ * @brief Checks if the given call is to a math library function whose only side effect is errno.
+ *
+ * The function is recognized by name and prototype through the target
+ * library info, so a call marked nobuiltin or a function of the same name
+ * with another signature is not.
+ *
+ * @param CI Reference to the LLVM call to be checked.
+ * @param TLI The library functions available on the target.
+ * @return true if the call only computes its result and may set errno.
+ */
+static bool isMathLibCall(CallInst &CI, const TargetLibraryInfo &TLI) {
+    LibFunc LF;
+    if (CI.isStrictFP() || !TLI.getLibFunc(CI, LF) || !TLI.has(LF)) {
+        return false;
+    }
+    switch (LF) {
+    case LibFunc_acos: case LibFunc_acosf: case LibFunc_acosl:
+    case LibFunc_acosh: case LibFunc_acoshf: case LibFunc_acoshl:
+    case LibFunc_asin: case LibFunc_asinf: case LibFunc_asinl:
+    case LibFunc_asinh: case LibFunc_asinhf: case LibFunc_asinhl:
+    case LibFunc_atan: case LibFunc_atanf: case LibFunc_atanl:
+    case LibFunc_atan2: case LibFunc_atan2f: case LibFunc_atan2l:
+    case LibFunc_atanh: case LibFunc_atanhf: case LibFunc_atanhl:
+    case LibFunc_cbrt: case LibFunc_cbrtf: case LibFunc_cbrtl:
+    case LibFunc_ceil: case LibFunc_ceilf: case LibFunc_ceill:
+    case LibFunc_copysign: case LibFunc_copysignf: case LibFunc_copysignl:
+    case LibFunc_cos: case LibFunc_cosf: case LibFunc_cosl:
+    case LibFunc_cosh: case LibFunc_coshf: case LibFunc_coshl:
+    case LibFunc_exp: case LibFunc_expf: case LibFunc_expl:
+    case LibFunc_exp10: case LibFunc_exp10f: case LibFunc_exp10l:
+    case LibFunc_exp2: case LibFunc_exp2f: case LibFunc_exp2l:
+    case LibFunc_expm1: case LibFunc_expm1f: case LibFunc_expm1l:
+    case LibFunc_fabs: case LibFunc_fabsf: case LibFunc_fabsl:
+    case LibFunc_floor: case LibFunc_floorf: case LibFunc_floorl:
+    case LibFunc_fmax: case LibFunc_fmaxf: case LibFunc_fmaxl:
+    case LibFunc_fmin: case LibFunc_fminf: case LibFunc_fminl:
+    case LibFunc_fmod: case LibFunc_fmodf: case LibFunc_fmodl:
+    case LibFunc_ldexp: case LibFunc_ldexpf: case LibFunc_ldexpl:
+    case LibFunc_log: case LibFunc_logf: case LibFunc_logl:
+    case LibFunc_log10: case LibFunc_log10f: case LibFunc_log10l:
+    case LibFunc_log1p: case LibFunc_log1pf: case LibFunc_log1pl:
+    case LibFunc_log2: case LibFunc_log2f: case LibFunc_log2l:
+    case LibFunc_logb: case LibFunc_logbf: case LibFunc_logbl:
+    case LibFunc_nearbyint: case LibFunc_nearbyintf: case LibFunc_nearbyintl:
+    case LibFunc_pow: case LibFunc_powf: case LibFunc_powl:
+    case LibFunc_remainder: case LibFunc_remainderf: case LibFunc_remainderl:
+    case LibFunc_rint: case LibFunc_rintf: case LibFunc_rintl:
+    case LibFunc_round: case LibFunc_roundf: case LibFunc_roundl:
+    case LibFunc_roundeven: case LibFunc_roundevenf: case LibFunc_roundevenl:
+    case LibFunc_sin: case LibFunc_sinf: case LibFunc_sinl:
+    case LibFunc_sinh: case LibFunc_sinhf: case LibFunc_sinhl:
+    case LibFunc_sqrt: case LibFunc_sqrtf: case LibFunc_sqrtl:
+    case LibFunc_tan: case LibFunc_tanf: case LibFunc_tanl:
+    case LibFunc_tanh: case LibFunc_tanhf: case LibFunc_tanhl:
+    case LibFunc_trunc: case LibFunc_truncf: case LibFunc_truncl:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+/**
+ * @brief Marks the math library calls of the given function as not accessing memory (-no-math-errno).
+ *
+ * With -no-math-errno the program never reads errno after a math library
+ * call, so a call such as sqrt or sin only computes its result. The calls
+ * get the attributes clang gives them under -fno-math-errno, after which a
+ * call folded to a constant or left without uses is erased, and repeated
+ * calls with the same arguments are merged like any other instruction.
+ *
+ * @param F Reference to the LLVM function whose calls are marked.
+ * @param AM The analyses cached for the function.
+ * @return true if a call was marked, false otherwise.
+ */
+static bool MarkMathLibCalls(Function &F, CSEAnalyses &AM) {
+    const TargetLibraryInfo &TLI = AM.getTLI();
+    bool Changed = false;
+    for (Instruction &I : instructions(F)) {
+        CallInst *CI = dyn_cast<CallInst>(&I);
+        if (CI == nullptr || CI->doesNotAccessMemory() || !isMathLibCall(*CI, TLI)) {
+            continue;
+        }
+        // Attribute lists are uniqued in the shared context
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        CI->setDoesNotAccessMemory();
+        CI->setDoesNotThrow();
+        CI->addFnAttr(Attribute::WillReturn);
+        Changed = true;
+    }
+    return Changed;
+}
+
+
+/**
+ * @brief Simplifies instructions within the given LLVM function.
+ * 
+ * This function visits the basic blocks in reverse post-order, simplifies
+ * the instructions queued in the worklist, and replaces them with simplified
+ * values if possible. Simplified instructions are those that can be simplified
+ * using LLVM's built-in simplification rules, which here may also use
+ * dominating conditions, assumptions, known library functions and the
+ * position of the instruction. In reverse post-order the operands of an
+ * instruction are visited before it, except through loop PHIs, so the users
+ * of a simplified instruction are simplified in the same call.
+ * 
+ * @param F Reference to the LLVM function to simplify instructions in.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function.
+ */
+static void SimplifyInstructions(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Simplify instruction start\n");
+
+    const SimplifyQuery Q = AM.getSimplifyQuery();
+    // Users of simplified instructions, visited in this call whether queued or not
+    SmallPtrSet<Instruction*, 16> simplifiedUsers;
+
+    // Iterate over the reachable basic blocks in reverse post-order
+    ReversePostOrderTraversal<Function*> RPOT(&F);
+    for (BasicBlock *BB : RPOT) {
+        std::vector<Instruction*> toEraseSimplify;
+
+        // Folding may create new constants in the shared context, so the block is simplified under one lock
+        std::unique_lock<std::mutex> Lock(ContextMutex);
+        // Iterate over all queued instructions in the basic block
+        for (Instruction &I : *BB) {
+            if (!WL.isQueued(&I) && !simplifiedUsers.count(&I)) {
+                continue;
+            }
+            Value *val = simplifyInstruction(&I, Q.getWithInstruction(&I));
+
+            // If the instruction was simplified, replace it with the simplified value
+            if (val != nullptr) {
+                for (User *U : I.users()) {
+                    if (Instruction *UI = dyn_cast<Instruction>(U)) {
+                        simplifiedUsers.insert(UI);
+                    }
+                }
+                replaceInstructionLocked(&I, val, WL);
+                // A folded library call may still have to run, e.g. to set errno
+                if (isInstructionTriviallyDead(&I, Q.TLI)) {
+                    toEraseSimplify.push_back(&I);
+                } else {
+                    CSESimplify++;
+                }
+            }
+        }
+        Lock.unlock();
+
+        // Remove simplified instructions from the basic block
+        if (toEraseSimplify.size() > 0) {
+            // Erase the instructions marked for elimination (simplification
+            for (Instruction *I : toEraseSimplify) {
+                simplifiedUsers.erase(I);
+                DEBUG_PRINT("erasing simplified instruction:\n\t");
+                debugPrintLLVMInstr(*I);
+                DEBUG_PRINT("\n");
+                eraseInstruction(I, WL);
+                CSESimplify++;
+            }
+        }
+    }
+
+    DEBUG_PRINT("Simplify instruction end\n");
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Optimization 1c: Reassociation
+// --------------------------------------------------------------------------------
+/**
+ * @brief Checks if the given LLVM instruction is a node of an expression tree that may be reassociated.
+ *
+ * Integer add, mul, and, or and xor are associative and commutative. Floating
+ * point fadd and fmul are only if their fast-math flags allow reassociation
+ * and ignore the sign of zero.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return true if the instruction may be reassociated, false otherwise.
+ */
+static bool isReassociable(Instruction &I) {
+    return isa<BinaryOperator>(I) && I.isAssociative() && I.isCommutative();
+}
+
+
+/**
+ * @brief Checks if the given value is an inner node of the expression tree computed by Parent.
+ *
+ * An inner node computes the same operation in the same block, and its only
+ * use is the node above it, so the tree can be rebuilt without keeping it.
+ * A node that CSE may still replace with an equal expression elsewhere is
+ * kept as a leaf, so that reassociation does not take the shared part apart.
+ *
+ * @param V Pointer to the operand of Parent to be checked.
+ * @param Parent Reference to the node of the tree that uses V.
+ * @param IsShared Whether an instruction is equal to another one of the function.
+ * @return The operand as an instruction if it is an inner node, nullptr otherwise.
+ */
+static Instruction *getInnerNode(Value *V, Instruction &Parent, function_ref<bool(Instruction*)> IsShared) {
+    Instruction *I = dyn_cast<Instruction>(V);
+    if (I == nullptr || I->getOpcode() != Parent.getOpcode() || I->getParent() != Parent.getParent() ||
+        !I->hasOneUse() || !isReassociable(*I) || IsShared(I)) {
+        return nullptr;
+    }
+    return I;
+}
+
+
+/**
+ * @brief Checks if the given LLVM instruction computes the top of an expression tree.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @param IsShared Whether an instruction is equal to another one of the function.
+ * @return true if the instruction may be reassociated and is not an inner node of another tree.
+ */
+static bool isReassociationRoot(Instruction &I, function_ref<bool(Instruction*)> IsShared) {
+    if (!isReassociable(I)) {
+        return false;
+    }
+    if (I.hasOneUse()) {
+        Instruction *User = dyn_cast<Instruction>(*I.user_begin());
+        if (User != nullptr && getInnerNode(&I, *User, IsShared) == &I) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Collects the leaves and the inner nodes of the expression tree computed by Root.
+ *
+ * The leaves are collected from left to right and the nodes from the top
+ * down, so every node comes before the nodes it uses.
+ *
+ * @param Root Reference to the top of the expression tree.
+ * @param Leaves The operands of the tree, in the order the tree combines them.
+ * @param Nodes The instructions of the tree, starting with Root.
+ * @param IsShared Whether an instruction is equal to another one of the function.
+ * @return true if the tree is a chain that only grows on the left, false otherwise.
+ */
+static bool collectExpressionTree(Instruction &Root, SmallVectorImpl<Value*> &Leaves,
+                                  SmallVectorImpl<Instruction*> &Nodes, function_ref<bool(Instruction*)> IsShared) {
+    bool Linear = true;
+    // Operands waiting to be visited, with whether they are inner nodes
+    SmallVector<std::pair<Value*, bool>, 8> Stack = {{&Root, true}};
+    while (!Stack.empty()) {
+        auto [V, IsNode] = Stack.pop_back_val();
+        if (!IsNode) {
+            Leaves.push_back(V);
+            continue;
+        }
+        Instruction *Node = cast<Instruction>(V);
+        Nodes.push_back(Node);
+        // The right operand is pushed first so that the left one is visited first
+        bool RightIsNode = getInnerNode(Node->getOperand(1), *Node, IsShared) != nullptr;
+        Linear &= !RightIsNode;
+        Stack.push_back({Node->getOperand(1), RightIsNode});
+        Stack.push_back({Node->getOperand(0), getInnerNode(Node->getOperand(0), *Node, IsShared) != nullptr});
+    }
+    return Linear;
+}
+
+
+/**
+ * @brief Ranks the values of a function for reassociation.
+ *
+ * Arguments rank lowest, then the values computed in each block, with the
+ * blocks in reverse post-order. A value computed only from other values takes
+ * the highest rank of its operands instead of the rank of its block, so it is
+ * combined as early as they are. Values of the same rank are ordered by where
+ * they are defined, so the order is the same on every run. Constants are
+ * combined last, where they can be folded into each other and do not keep
+ * otherwise equal partial results apart.
+ */
+class CSEExpressionRanks {
+public:
+    explicit CSEExpressionRanks(Function &F) {
+        unsigned Position = 0;
+        for (Argument &A : F.args()) {
+            Ranks[&A] = {A.getArgNo() + 1, ++Position};
+        }
+        // Block ranks leave room for all arguments below them
+        unsigned BlockRank = F.arg_size() + 1;
+        ReversePostOrderTraversal<Function*> RPOT(&F);
+        for (BasicBlock *BB : RPOT) {
+            ++BlockRank;
+            for (Instruction &I : *BB) {
+                unsigned Rank = BlockRank;
+                if (!isa<PHINode>(I) && !I.mayReadOrWriteMemory() && !I.isTerminator()) {
+                    Rank = 0;
+                    for (Value *Op : I.operands()) {
+                        Rank = std::max(Rank, get(Op).first);
+                    }
+                }
+                Ranks[&I] = {Rank, ++Position};
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the rank of the value, and the position that orders values of the same rank.
+     */
+    std::pair<unsigned, unsigned> get(Value *V) const {
+        auto It = Ranks.find(V);
+        return It != Ranks.end() ? It->second : std::make_pair(0u, 0u);
+    }
+
+    /**
+     * @brief Gives a new instruction the rank of the instruction it replaces.
+     */
+    void assign(Value *V, Value *From) {
+        Ranks[V] = get(From);
+    }
+
+    /**
+     * @brief Checks if the leaves are already in the order the canonical tree combines them.
+     */
+    bool isSorted(ArrayRef<Value*> Leaves) const {
+        return std::is_sorted(Leaves.begin(), Leaves.end(),
+                              [this](Value *A, Value *B) { return getOrder(A) < getOrder(B); });
+    }
+
+    /**
+     * @brief Puts the leaves in the order the canonical tree combines them, lowest rank first.
+     */
+    void sort(MutableArrayRef<Value*> Leaves) const {
+        std::stable_sort(Leaves.begin(), Leaves.end(),
+                         [this](Value *A, Value *B) { return getOrder(A) < getOrder(B); });
+    }
+
+private:
+    std::tuple<bool, unsigned, unsigned> getOrder(Value *V) const {
+        std::pair<unsigned, unsigned> Rank = get(V);
+        return {isa<Constant>(V), Rank.first, Rank.second};
+    }
+
+    DenseMap<Value*, std::pair<unsigned, unsigned>> Ranks;
+};
+
+
+/**
+ * @brief Checks if the given value is a constant that always folds with another one of its kind.
+ */
+static bool isFoldableLeaf(Value *V) {
+    return isa<ConstantInt>(V) || isa<ConstantFP>(V);
+}
+
+
+/**
+ * @brief Checks if the expression tree is already in the canonical order.
+ *
+ * Trees of two leaves are left to CSE, which already matches the swapped
+ * operands of commutative instructions, which is also why the first two
+ * leaves may come in either order. A canonical tree ends in at most one
+ * integer or floating point constant.
+ *
+ * @param Leaves The leaves of the tree, from left to right.
+ * @param Linear Whether the tree is a chain that only grows on the left.
+ * @param Ranks The ranks of the values of the function.
+ * @return true if rebuilding the tree would not change it, false otherwise.
+ */
+static bool isCanonicalTree(ArrayRef<Value*> Leaves, bool Linear, const CSEExpressionRanks &Ranks) {
+    if (Leaves.size() < 3) {
+        return true;
+    }
+    bool FoldableTail = isFoldableLeaf(Leaves[Leaves.size() - 1]) && isFoldableLeaf(Leaves[Leaves.size() - 2]);
+    SmallVector<Value*, 8> Order(Leaves.begin(), Leaves.end());
+    Ranks.sort(MutableArrayRef<Value*>(Order).take_front(2));
+    return Linear && Ranks.isSorted(Order) && !FoldableTail;
+}
+
+
+/**
+ * @brief Reassociates the expression trees of the given LLVM function into a canonical order.
+ *
+ * This function visits the basic blocks in reverse post-order and collects the
+ * expression tree of every instruction that computes an associative and
+ * commutative operation, like (a + b) + c. The tree is rebuilt as a chain that
+ * combines its leaves from the lowest rank to the highest, ((a + b) + c), so
+ * that expressions over the same values become literally equal and partial
+ * results over earlier values can be shared by CSE. Constants are combined
+ * last and folded into a single one. A node of the tree that already combines
+ * the same two operands is kept as it is. New nodes do not get the nsw and
+ * nuw flags, which need not hold for the new partial results, and only get
+ * the fast-math flags common to the whole tree.
+ *
+ * @param F Reference to the LLVM function to reassociate.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function.
+ */
+static void ReassociateExpressions(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Reassociation start\n");
+
+    CSEExpressionRanks Ranks(F);
+
+    // A node equal to another operation of the function is shared after CSE, fingerprints only pick the candidates
+    CSEFingerprintCache &FP = AM.getFingerprints();
+    DenseMap<unsigned, SmallVector<Instruction*, 2>> Fingerprints;
+    for (Instruction &I : instructions(F)) {
+        if (isReassociable(I)) {
+            Fingerprints[FP.get(&I)].push_back(&I);
+        }
+    }
+    SmallPtrSet<Instruction*, 16> Shared;
+    for (auto &Entry : Fingerprints) {
+        // Each candidate is compared with the first one of every distinct operation seen so far
+        SmallVector<Instruction*, 2> Leaders;
+        for (Instruction *Candidate : Entry.second) {
+            auto Leader = llvm::find_if(Leaders, [&](Instruction *L) { return isEquivalentMatch(*L, *Candidate); });
+            if (Leader == Leaders.end()) {
+                Leaders.push_back(Candidate);
+                continue;
+            }
+            Shared.insert(*Leader);
+            Shared.insert(Candidate);
+        }
+    }
+    auto IsShared = [&](Instruction *I) { return Shared.count(I) != 0; };
+
+    ReversePostOrderTraversal<Function*> RPOT(&F);
+    for (BasicBlock *BB : RPOT) {
+        // The inner nodes of a tree come before its root, and are erased after it is visited
+        for (Instruction &I : llvm::make_early_inc_range(*BB)) {
+            if (!isReassociationRoot(I, IsShared)) {
+                continue;
+            }
+            SmallVector<Value*, 8> Leaves;
+            SmallVector<Instruction*, 8> Nodes;
+            bool Linear = collectExpressionTree(I, Leaves, Nodes, IsShared);
+            if (isCanonicalTree(Leaves, Linear, Ranks)) {
+                continue;
+            }
+
+            DEBUG_PRINT("reassociating expression tree:\n\t");
+            debugPrintLLVMInstr(I);
+            DEBUG_PRINT("\n");
+
+            FastMathFlags FMF;
+            if (isa<FPMathOperator>(I)) {
+                FMF = I.getFastMathFlags();
+                for (Instruction *Node : Nodes) {
+                    FMF &= Node->getFastMathFlags();
+                }
+            }
+
+            // Inner nodes that already combine the right operands are reused with their flags
+            DenseMap<std::pair<Value*, Value*>, Instruction*> Combined;
+            for (Instruction *Node : llvm::drop_begin(Nodes)) {
+                Combined.try_emplace({Node->getOperand(0), Node->getOperand(1)}, Node);
+                Combined.try_emplace({Node->getOperand(1), Node->getOperand(0)}, Node);
+            }
+            SmallPtrSet<Instruction*, 8> Reused;
+
+            // Rebuild the tree in front of its root, folding and new instructions use constants of the shared context
+            Ranks.sort(Leaves);
+            Value *Chain = Leaves.front();
+            {
+                std::lock_guard<std::mutex> Lock(ContextMutex);
+                while (Leaves.size() > 1 && isFoldableLeaf(Leaves[Leaves.size() - 1]) &&
+                       isFoldableLeaf(Leaves[Leaves.size() - 2])) {
+                    Constant *RHS = cast<Constant>(Leaves.pop_back_val());
+                    Constant *Folded = ConstantFoldBinaryOpOperands(I.getOpcode(), cast<Constant>(Leaves.back()),
+                                                                    RHS, F.getParent()->getDataLayout());
+                    if (Folded == nullptr) {
+                        Leaves.push_back(RHS);
+                        break;
+                    }
+                    Leaves.back() = Folded;
+                }
+                Chain = Leaves.front();
+                for (Value *Leaf : llvm::drop_begin(Leaves)) {
+                    auto It = Combined.find({Chain, Leaf});
+                    if (It != Combined.end() && Reused.insert(It->second).second) {
+                        Chain = It->second;
+                        continue;
+                    }
+                    BinaryOperator *Node = BinaryOperator::Create(
+                            static_cast<Instruction::BinaryOps>(I.getOpcode()), Chain, Leaf, "", &I);
+                    if (isa<FPMathOperator>(Node)) {
+                        Node->setFastMathFlags(FMF);
+                    }
+                    Node->setDebugLoc(I.getDebugLoc());
+                    Ranks.assign(Node, &I);
+                    WL.push(Node);
+                    Chain = Node;
+                }
+            }
+            replaceInstruction(&I, Chain, WL);
+
+            // Every other node was only used by the node above it
+            for (Instruction *Node : Nodes) {
+                if (!Reused.count(Node)) {
+                    // A new node may later be allocated at its address
+                    Shared.erase(Node);
+                    eraseInstruction(Node, WL);
+                }
+            }
+            CSEReassoc++;
+        }
+    }
+
+    DEBUG_PRINT("Reassociation end\n");
+}
+
+
+// --------------------------------------------------------------------------------
+//                      Optimization 2: Common Subexpression Elimination
+// --------------------------------------------------------------------------------
+/**
+ * @brief Checks if the given LLVM instruction is a call that may be merged with an identical one.
+ *
+ * A call that does not write memory (memory(read) or memory(none)) returns
+ * the same value for the same arguments and memory. The later of two such
+ * calls may go even if the call may not return or may unwind, the earlier
+ * one would have done so first. Convergent calls also depend on the threads
+ * that run them together, and calls without a result are not merged.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return true if the instruction is such a call, false otherwise.
+ */
+static bool isMergeableCall(Instruction &I) {
+    CallInst *CI = dyn_cast<CallInst>(&I);
+    return CI != nullptr && CI->onlyReadsMemory() && !CI->isConvergent() && !CI->getType()->isVoidTy();
+}
+
+
+/**
+ * @brief Checks if the given LLVM instruction is a mergeable call that does not access memory at all.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return true if CSE may treat the call like any other expression, false otherwise.
+ */
+static bool isReadNoneCall(Instruction &I) {
+    return isMergeableCall(I) && cast<CallInst>(I).doesNotAccessMemory();
+}
+
+
+/**
+ * @brief Checks if the given LLVM instruction has side effects.
+ * 
+ * This function determines whether the given instruction has side effects
+ * based on its opcode. Instructions with certain opcodes are considered
+ * to have side effects, such as calls, stores, allocations, loads, etc.
+ * Calls that do not access memory are expressions like any other.
+ * 
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return true if the instruction has side effects, false otherwise.
+ */
+static bool isSideEffectInstruction(Instruction &I) {
+    // Check if the opcode of the instruction indicates a side effect
+    return (
+        (I.getOpcode() == Instruction::Call && !isReadNoneCall(I)) ||
+        (I.getOpcode() == Instruction::Store)       ||
+        (I.getOpcode() == Instruction::Alloca)      ||
+        (I.getOpcode() == Instruction::Load)        ||
+        (I.getOpcode() == Instruction::Fence)       ||
+        (I.getOpcode() == Instruction::Br)          ||
+        (I.getOpcode() == Instruction::Invoke)      ||
+        (I.getOpcode() == Instruction::Resume)      ||
+        (I.getOpcode() == Instruction::Unreachable)
+    );
+}
+
+
+/**
+ * @brief Checks if the given LLVM instructions compute the same value.
+ * 
+ * Identical instructions match, and so do two instructions that differ only
+ * in the order of their operands when that order does not matter: the
+ * operands of a commutative operation like add, mul, and, or, xor, fadd or
+ * fmul, and the operands of a compare whose predicate is swapped along with
+ * them (icmp slt a, b and icmp sgt b, a). Flags like nsw, exact, inbounds
+ * or the fast-math flags may differ, the instruction that is kept only keeps
+ * the flags both have.
+ * 
+ * @param I Reference to the first LLVM instruction to be compared.
+ * @param J Reference to the second LLVM instruction to be compared.
+ * @return true if the instructions compute the same value, false otherwise.
+ */
+static bool isEquivalentMatch(Instruction &I, Instruction &J) {
+    if (I.isIdenticalToWhenDefined(&J)) {
+        return true;
+    }
+
+    // Check if the instructions are the same operation on swapped operands
+    if (I.getOpcode() != J.getOpcode() ||
+        I.getType() != J.getType() ||
+        I.getNumOperands() != 2 ||
+        J.getNumOperands() != 2 ||
+        I.getOperand(0) != J.getOperand(1) ||
+        I.getOperand(1) != J.getOperand(0)) {
+        return false;
+    }
+
+    // Compare instructions (FCmp or ICmp) match with the predicate swapped
+    if (CmpInst *CI = dyn_cast<CmpInst>(&I)) {
+        return CI->getPredicate() == cast<CmpInst>(J).getSwappedPredicate();
+    }
+    return isa<BinaryOperator>(I) && I.isCommutative();
+}
+
+
+/**
+ * @brief An entry of the CSE table: an instruction and its cached fingerprint.
+ */
+struct CSEExpr {
+    Instruction *Inst;
+    unsigned Hash;
+};
+
+struct CSEExprInfo {
+    static inline CSEExpr getEmptyKey() {
+        return {DenseMapInfo<Instruction*>::getEmptyKey(), 0};
+    }
+
+    static inline CSEExpr getTombstoneKey() {
+        return {DenseMapInfo<Instruction*>::getTombstoneKey(), 0};
+    }
+
+    static bool isSentinel(const CSEExpr &E) {
+        return E.Inst == getEmptyKey().Inst || E.Inst == getTombstoneKey().Inst;
+    }
+
+    static unsigned getHashValue(const CSEExpr &E) {
+        return E.Hash;
+    }
+
+    static bool isEqual(const CSEExpr &LHS, const CSEExpr &RHS) {
+        if (isSentinel(LHS) || isSentinel(RHS)) {
+            return LHS.Inst == RHS.Inst;
+        }
+        // Different fingerprints tell the pair apart without walking the operands
+        return LHS.Hash == RHS.Hash && isEquivalentMatch(*LHS.Inst, *RHS.Inst);
+    }
+};
+
+typedef RecyclingAllocator<BumpPtrAllocator,
+                           ScopedHashTableVal<CSEExpr, Instruction*>> CSEAllocatorTy;
+typedef ScopedHashTable<CSEExpr, Instruction*, CSEExprInfo, CSEAllocatorTy> CSETableTy;
+typedef ScopedHashTableScope<CSEExpr, Instruction*, CSEExprInfo, CSEAllocatorTy> CSEScopeTy;
+
+
+/**
+ * @brief Checks if the given LLVM instruction may take part in CSE.
+ *
+ * Side effect instructions, terminators and anything LLVM reports as writing
+ * memory or throwing are never entered into, or looked up in, the CSE table.
+ * The exception are calls that do not access memory, which may only count
+ * as side effects because they may not return.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return true if the instruction can be replaced by an identical dominating one.
+ */
+static bool isCSECandidate(Instruction &I) {
+    return (
+        (!isSideEffectInstruction(I))                   &&
+        (!I.isTerminator())                             &&
+        (!I.isEHPad())                                  &&
+        (!I.mayHaveSideEffects() || isReadNoneCall(I))  &&
+        (!I.getType()->isVoidTy())
+    );
+}
+
+
+/**
+ * @brief One frame of the iterative dominator tree walk used by CSE.
+ *
+ * Owning the scope here means every table entry added while visiting Node is
+ * popped again as soon as the walk leaves Node's dominator subtree.
+ */
+struct CSEStackNode {
+    CSEStackNode(CSETableTy &Table, DomTreeNode *N)
+        : Scope(Table), Node(N), ChildIter(N->begin()), EndIter(N->end()) {}
+
+    CSEScopeTy Scope;
+    DomTreeNode *Node;
+    DomTreeNode::const_iterator ChildIter;
+    DomTreeNode::const_iterator EndIter;
+    bool Processed = false;
+};
+
+
+/**
+ * @brief Replaces redundant instructions of a single block using the CSE table.
+ *
+ * Every candidate instruction is looked up once. A hit means an identical
+ * instruction dominates it, so all uses are redirected and the instruction is
+ * erased right away; a miss makes the instruction the leader for the rest of
+ * the dominator subtree.
+ *
+ * @param BB Reference to the basic block to be processed.
+ * @param Table The scoped table holding the leaders of all dominating blocks.
+ * @param WL The worklist of the function being optimized.
+ * @param FP The fingerprints of the function being optimized.
+ */
+static void processCSEBlock(BasicBlock &BB, CSETableTy &Table, CSEWorklist &WL, CSEFingerprintCache &FP) {
+    for (Instruction &I : llvm::make_early_inc_range(BB)) {
+        if (!isCSECandidate(I)) {
+            continue;
+        }
+
+        CSEExpr Expr = {&I, FP.get(&I)};
+        if (Instruction *Leader = Table.lookup(Expr)) {
+            DEBUG_PRINT("found CSE in block " << BB.getName() << "\n");
+            debugPrintLLVMInstr(I);
+            DEBUG_PRINT("\n");
+            // The leader now also computes I, so it may only keep the flags both promise
+            Leader->andIRFlags(&I);
+            replaceInstruction(&I, Leader, WL);
+            eraseInstruction(&I, WL);
+            CSEElim++;
+            continue;
+        }
+
+        Table.insert(Expr, &I);
+    }
+}
+
+
+/**
+ * @brief Performs common subexpression elimination (CSE) on the given LLVM function.
+ *
+ * This function walks the dominator tree of the function once, in preorder,
+ * keeping a scoped hash table of the instructions available in the dominating
+ * blocks. Each instruction is looked up in the table with a single hash probe,
+ * so the cost grows linearly with the size of the function instead of with the
+ * number of instruction pairs.
+ *
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function being optimized.
+ */
+static void performCSE(CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("CSE start\n");
+
+    // The dominator tree is shared with the other sweeps; CSE never changes the CFG
+    DominatorTree &DT = AM.getDomTree();
+
+    CSETableTy Table;
+    std::vector<std::unique_ptr<CSEStackNode>> Stack;
+    Stack.push_back(std::make_unique<CSEStackNode>(Table, DT.getRootNode()));
+
+    // Walk the dominator tree without recursion, deep trees are common in large functions
+    while (!Stack.empty()) {
+        CSEStackNode &Top = *Stack.back();
+        if (!Top.Processed) {
+            processCSEBlock(*Top.Node->getBlock(), Table, WL, AM.getFingerprints());
+            Top.Processed = true;
+        }
+
+        if (Top.ChildIter != Top.EndIter) {
+            DomTreeNode *Child = *Top.ChildIter++;
+            Stack.push_back(std::make_unique<CSEStackNode>(Table, Child));
+        } else {
+            // Leaving the subtree pops its scope
+            Stack.pop_back();
+        }
+    }
+
+    DEBUG_PRINT("CSE end\n");
+}
+
+// --------------------------------------------------------------------------------
+//                      Optimization 3: Eliminate Redundant Loads
+// --------------------------------------------------------------------------------
+/**
+ * @brief Checks whether an instruction may write the memory a load or store accesses.
+ *
+ * Alias analysis rules out stores to provably different objects, such as
+ * another alloca or a disjoint field of the same one, and calls that cannot
+ * reach the memory, such as calls made while a local has not escaped.
+ *
+ * @param I Reference to the instruction between the two memory accesses.
+ * @param Loc The memory location accessed by the earlier load or store.
+ * @param AA The alias analysis of the function.
+ * @return true if I may write Loc, false otherwise.
+ */
+static bool mayClobberLocation(Instruction &I, const MemoryLocation &Loc, BatchAAResults &AA) {
+    return isModSet(AA.getModRefInfo(&I, Loc));
+}
+
+
+/**
+ * @brief Checks if a load may be replaced with the value of an earlier access of the same address.
+ *
+ * Volatile loads and loads that order other memory accesses have to stay. An
+ * unordered atomic load must not see a torn value, so it only takes the value
+ * of an access that is atomic as well.
+ *
+ * @param LI Reference to the load to be replaced.
+ * @param PriorOrdering The atomic ordering of the earlier load or store.
+ * @return true if the load may be replaced, false otherwise.
+ */
+static bool isReplaceableLoad(const LoadInst &LI, AtomicOrdering PriorOrdering) {
+    return LI.isUnordered() && !isStrongerThan(LI.getOrdering(), PriorOrdering);
+}
+
+
+/**
+ * @brief A pointer split into the value it is computed from and a constant byte offset.
+ */
+typedef std::pair<const Value*, int64_t> PointerAddress;
+
+
+/**
+ * @brief Splits a pointer into the value it is computed from and a constant byte offset.
+ *
+ * Casts and GEPs with constant indices are looked through, so two different
+ * GEPs of the same field, or a pointer and a cast of it, get equal addresses.
+ *
+ * @param Ptr The pointer to be split.
+ * @param DL The data layout of the module.
+ * @return The base pointer and the offset of Ptr from it in bytes.
+ */
+static PointerAddress getPointerAddress(const Value *Ptr, const DataLayout &DL) {
+    int64_t Offset = 0;
+    const Value *Base = GetPointerBaseWithConstantOffset(Ptr, Offset, DL);
+    return {Base, Offset};
+}
+
+
+/**
+ * @brief The loads or stores of a block that are still live, grouped by the object they access.
+ *
+ * Accesses to two different identified objects (allocas, globals, noalias
+ * arguments) never alias, and BasicAA answers such queries with NoAlias. A
+ * plain load or store of an identified object therefore only has to be
+ * checked against the entries of the same object and of unidentified ones,
+ * which keeps a block that touches many locals at a linear number of alias
+ * queries. Anything else, like a call, is checked against every entry.
+ * Entries are found by the address they access rather than by the pointer
+ * value, so an access through an equal GEP or a cast matches as well.
+ */
+template <typename AccessTy>
+class BlockAccessTable {
+public:
+    explicit BlockAccessTable(const DataLayout &DL) : DL(DL) {}
+
+    void insert(AccessTy *A) {
+        const Value *Obj = getUnderlyingObject(A->getPointerOperand());
+        if (!isIdentifiedObject(Obj)) {
+            Unidentified.insert(Obj);
+        }
+        Entries[Obj].push_back({A, getPointerAddress(A->getPointerOperand(), DL)});
+    }
+
+    /**
+     * @brief Returns the first live entry accessing the same address as the given pointer that satisfies Match.
+     */
+    AccessTy *find(Value *Ptr, function_ref<bool(AccessTy *)> Match) {
+        auto It = Entries.find(getUnderlyingObject(Ptr));
+        if (It == Entries.end()) {
+            return nullptr;
+        }
+        PointerAddress Addr = getPointerAddress(Ptr, DL);
+        for (const Entry &E : It->second) {
+            if (E.Addr == Addr && Match(E.Access)) {
+                return E.Access;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Calls Visit on every entry the instruction may access and drops those it returns true for.
+     *
+     * @param I Reference to the instruction that may read or write memory.
+     * @param Visit Decides whether an entry stops being live at I.
+     */
+    void removeIf(Instruction &I, function_ref<bool(AccessTy *)> Visit) {
+        const Value *Obj = getPlainAccessObject(I);
+        if (Obj == nullptr || !isIdentifiedObject(Obj)) {
+            for (auto It = Entries.begin(), E = Entries.end(); It != E;) {
+                auto Cur = It++;
+                visitObject(Cur, Visit);
+            }
+            return;
+        }
+
+        auto It = Entries.find(Obj);
+        if (It != Entries.end()) {
+            visitObject(It, Visit);
+        }
+        for (const Value *U : SmallVector<const Value*, 8>(Unidentified.begin(), Unidentified.end())) {
+            visitObject(Entries.find(U), Visit);
+        }
+    }
+
+private:
+    struct Entry {
+        AccessTy *Access;
+        PointerAddress Addr;
+    };
+    typedef DenseMap<const Value*, SmallVector<Entry, 4>> EntryMap;
+
+    /**
+     * @brief Returns the object a simple load or store accesses, or nullptr for anything else.
+     */
+    static const Value *getPlainAccessObject(Instruction &I) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+            return LI->isUnordered() ? getUnderlyingObject(LI->getPointerOperand()) : nullptr;
+        }
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+            return SI->isUnordered() ? getUnderlyingObject(SI->getPointerOperand()) : nullptr;
+        }
+        return nullptr;
+    }
+
+    void visitObject(typename EntryMap::iterator It, function_ref<bool(AccessTy *)> Visit) {
+        erase_if(It->second, [Visit](const Entry &E) { return Visit(E.Access); });
+        if (It->second.empty()) {
+            Unidentified.erase(It->first);
+            Entries.erase(It);
+        }
+    }
+
+    const DataLayout &DL;
+    EntryMap Entries;
+    SmallPtrSet<const Value*, 8> Unidentified;
+};
+
+
+/**
+ * @brief Eliminates redundant load instructions within the given LLVM function.
+ * 
+ * This function iterates over the basic blocks of the function queued in the
+ * worklist to identify and eliminate redundant load instructions.
+ * A load instruction is considered redundant if there is another load instruction earlier
+ * in the same basic block that loads the same address, has the same type of operand, and
+ * no instruction between them may write the loaded memory according to alias analysis.
+ *
+ * Each block is scanned once, front to back, keeping a table of the earliest
+ * load of every address and type whose value is still in memory. A load found
+ * in the table is replaced right away; an instruction that may write memory
+ * drops exactly the entries whose memory it may write. Calls that only read
+ * memory are kept available the same way, and a later identical call is
+ * replaced with the earlier one (counted as CSEElim).
+ * 
+ * @param F Reference to the LLVM function to eliminate redundant loads from.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function being optimized.
+ */
+static void EliminateRedundantLoads(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Eliminate redundant loads start\n");
+
+    // Iterate over all queued basic blocks in the function
+    for (BasicBlock &BB : F) {
+        if (!WL.isQueued(&BB)) {
+            continue;
+        }
+
+        // Set to collect redundant loads within the basic block
+        SmallSetVector<Instruction*, 16> toEraseRedundantLoads;
+        std::vector<Instruction*> toEraseRedundantCalls;
+        BatchAAResults AA(AM.getAAResults());
+        BlockAccessTable<LoadInst> availableLoads(F.getParent()->getDataLayout());
+        // Calls that only read memory, whose result is still the same
+        std::vector<CallInst*> availableCalls;
+
+        // Iterate over all instructions in the basic block
+        for (Instruction &I : BB) {
+            // Check if an identical call that reads the same memory came earlier
+            if (isMergeableCall(I) && !isReadNoneCall(I)) {
+                auto Prior = llvm::find_if(availableCalls, [&I](CallInst *CI) { return CI->isIdenticalToWhenDefined(&I); });
+                if (Prior != availableCalls.end()) {
+                    DEBUG_PRINT("redundant call found\n");
+                    debugPrintLLVMInstr(I);
+                    (*Prior)->andIRFlags(&I);
+                    replaceInstruction(&I, *Prior, WL);
+                    toEraseRedundantCalls.push_back(&I);
+                    continue;
+                }
+                availableCalls.push_back(cast<CallInst>(&I));
+            }
+
+            LoadInst *LI = dyn_cast<LoadInst>(&I);
+            auto canReuse = [LI](LoadInst *Prior) {
+                return Prior->getType() == LI->getType() && isReplaceableLoad(*LI, Prior->getOrdering());
+            };
+
+            // Check if an earlier load of the same address and type is still available
+            if (LI != nullptr && LI->isUnordered()) {
+                if (LoadInst *Prior = availableLoads.find(LI->getPointerOperand(), canReuse)) {
+                    DEBUG_PRINT("redundant load found\n");
+                    debugPrintLLVMInstr(*LI);
+                    // Replace uses of LI with the earlier load and mark LI for erasing
+                    replaceInstruction(LI, Prior, WL);
+                    toEraseRedundantLoads.insert(LI);
+                    continue;
+                }
+            }
+
+            // Forget the loads and calls whose memory this instruction may change
+            if (I.mayWriteToMemory()) {
+                availableLoads.removeIf(I, [&](LoadInst *Prior) {
+                    return mayClobberLocation(I, MemoryLocation::get(Prior), AA);
+                });
+                erase_if(availableCalls, [&](CallInst *Prior) { return isModSet(AA.getModRefInfo(&I, Prior)); });
+            }
+
+            // Only the earliest load of an address and type has to stay available
+            if (LI != nullptr && !availableLoads.find(LI->getPointerOperand(), canReuse)) {
+                availableLoads.insert(LI);
+            }
+        }
+        
+        // Eliminate collected redundant loads and update the counter
+        if (toEraseRedundantLoads.size() > 0) {
+            for (Instruction *redload : toEraseRedundantLoads) {
+                DEBUG_PRINT("erasing redundant load: \n\t");
+                debugPrintLLVMInstr(*redload);
+                eraseInstruction(redload, WL);
+                CSELdElim++;
+            }
+        }
+        for (Instruction *redcall : toEraseRedundantCalls) {
+            DEBUG_PRINT("erasing redundant call: \n\t");
+            debugPrintLLVMInstr(*redcall);
+            eraseInstruction(redcall, WL);
+            CSEElim++;
+        }
+    }
+
+    DEBUG_PRINT("Eliminate redundant loads end\n");
+}
+
+// --------------------------------------------------------------------------------
+//                      Optimization 4: Eliminate Redundant Stores
+// --------------------------------------------------------------------------------
+/**
+ * @brief Returns the instruction as a memset or memcpy whose bytes can be followed, or nullptr.
+ *
+ * Only non-volatile calls of a constant length qualify. A memmove is left
+ * out, since its source may overlap the bytes it writes.
+ *
+ * @param I Reference to the LLVM instruction to be checked.
+ * @return The memset or memcpy, or nullptr for anything else.
+ */
+static MemIntrinsic *getForwardableMemIntrinsic(Instruction &I) {
+    MemIntrinsic *MI = dyn_cast<MemIntrinsic>(&I);
+    if (MI == nullptr || MI->isVolatile() || !isa<ConstantInt>(MI->getLength()) ||
+        !(isa<MemSetInst>(MI) || isa<MemCpyInst>(MI))) {
+        return nullptr;
+    }
+    return MI;
+}
+
+
+/**
+ * @brief Checks if the Size bytes at Ptr lie within the bytes a memset or memcpy writes.
+ *
+ * Both pointers are split into a base pointer and a constant byte offset, so
+ * a field reached through a GEP of the destination is found at its offset.
+ *
+ * @param Ptr The pointer that is accessed.
+ * @param Size The number of bytes accessed.
+ * @param MI The memset or memcpy.
+ * @param DL The data layout of the module.
+ * @param Offset Receives the offset of Ptr from the destination in bytes.
+ * @return true if every accessed byte is written by MI, false otherwise.
+ */
+static bool isWithinMemIntrinsic(Value *Ptr, TypeSize Size, MemIntrinsic &MI, const DataLayout &DL,
+                                 int64_t &Offset) {
+    if (Size.isScalable()) {
+        return false;
+    }
+    int64_t PtrOffset = 0;
+    int64_t DestOffset = 0;
+    if (GetPointerBaseWithConstantOffset(Ptr, PtrOffset, DL) !=
+        GetPointerBaseWithConstantOffset(MI.getDest(), DestOffset, DL)) {
+        return false;
+    }
+    Offset = PtrOffset - DestOffset;
+    return Offset >= 0 &&
+           uint64_t(Offset) + Size.getFixedValue() <= cast<ConstantInt>(MI.getLength())->getZExtValue();
+}
+
+
+/**
+ * @brief Returns the constant a load of the given type reads from memory filled with one byte.
+ *
+ * @param Byte The byte every loaded byte holds.
+ * @param Ty The type of the load.
+ * @param DL The data layout of the module.
+ * @return The loaded constant, or nullptr if the type is not one whose bits are all loaded bytes.
+ */
+static Constant *getMemSetValue(ConstantInt *Byte, Type *Ty, const DataLayout &DL) {
+    TypeSize Bits = DL.getTypeSizeInBits(Ty);
+    if (Bits.isScalable() || Bits != DL.getTypeStoreSizeInBits(Ty)) {
+        return nullptr;
+    }
+    if (Ty->isPtrOrPtrVectorTy()) {
+        return Byte->isZero() ? Constant::getNullValue(Ty) : nullptr;
+    }
+    if (!Ty->isIntOrIntVectorTy() && !Ty->isFPOrFPVectorTy()) {
+        return nullptr;
+    }
+    Constant *Splat = ConstantInt::get(Ty->getContext(), APInt::getSplat(Bits.getFixedValue(), Byte->getValue()));
+    return Ty->isIntegerTy() ? Splat : ConstantFoldCastOperand(Instruction::BitCast, Splat, Ty, DL);
+}
+
+
+/**
+ * @brief Finds a pointer to the given byte of the source of a memcpy that is available at a load.
+ *
+ * Only the source itself or a GEP of it computed earlier in the block of the
+ * load is used, so following the memcpy never adds address arithmetic. The
+ * source is often a global whose users are shared by every function, so the
+ * caller holds ContextMutex.
+ *
+ * @param MC The memcpy.
+ * @param Offset The offset from the start of the source in bytes.
+ * @param LI Reference to the load the pointer is needed at.
+ * @param DL The data layout of the module.
+ * @return The pointer, or nullptr if there is none.
+ */
+static Value *findMemCpySourceAddress(MemCpyInst &MC, int64_t Offset, LoadInst &LI, const DataLayout &DL) {
+    Value *Src = MC.getSource();
+    if (Offset == 0) {
+        return Src;
+    }
+    int64_t SrcOffset = 0;
+    const Value *SrcBase = GetPointerBaseWithConstantOffset(Src, SrcOffset, DL);
+    for (User *U : Src->users()) {
+        GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(U);
+        if (GEP == nullptr || GEP->getParent() != LI.getParent() || !GEP->comesBefore(&LI)) {
+            continue;
+        }
+        int64_t GEPOffset = 0;
+        if (GetPointerBaseWithConstantOffset(GEP, GEPOffset, DL) == SrcBase && GEPOffset == SrcOffset + Offset) {
+            return GEP;
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * @brief Returns the value a load reads from the bytes of a memset or memcpy, or nullptr.
+ *
+ * A load within the bytes of a memset of a constant reads a constant. A load
+ * within the destination of a memcpy reads what the same load from the source
+ * would, so if the source address is at hand such a load is created in front
+ * of it; the caller makes sure the source has not changed since the memcpy.
+ *
+ * @param MI The memset or memcpy that last wrote the loaded bytes.
+ * @param LI Reference to the load.
+ * @param DL The data layout of the module.
+ * @param WL The worklist of the function being optimized.
+ * @return The value to replace the load with, or nullptr.
+ */
+static Value *getMemIntrinsicValue(MemIntrinsic &MI, LoadInst &LI, const DataLayout &DL, CSEWorklist &WL) {
+    int64_t Offset;
+    if (!isWithinMemIntrinsic(LI.getPointerOperand(), DL.getTypeStoreSize(LI.getType()), MI, DL, Offset)) {
+        return nullptr;
+    }
+
+    if (MemSetInst *MS = dyn_cast<MemSetInst>(&MI)) {
+        ConstantInt *Byte = dyn_cast<ConstantInt>(MS->getValue());
+        if (Byte == nullptr) {
+            return nullptr;
+        }
+        // Folding may create new constants in the shared context
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        return getMemSetValue(Byte, LI.getType(), DL);
+    }
+
+    MemCpyInst &MC = cast<MemCpyInst>(MI);
+    LoadInst *SrcLI;
+    {
+        // Walking the users of the source and adding one change its shared use list
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        Value *SrcPtr = findMemCpySourceAddress(MC, Offset, LI, DL);
+        if (SrcPtr == nullptr) {
+            return nullptr;
+        }
+        SrcLI = new LoadInst(LI.getType(), SrcPtr, "", false,
+                             commonAlignment(MC.getSourceAlign().valueOrOne(), Offset), &LI);
+    }
+    SrcLI->takeName(&LI);
+    WL.push(SrcLI);
+    if (MemorySSAUpdater *MSSAU = WL.getMemorySSAUpdater()) {
+        // Nothing since the memcpy wrote the source, so its access is a valid definition
+        MemorySSA *MSSA = MSSAU->getMemorySSA();
+        MemoryUseOrDef *Access = MSSA->getMemoryAccess(&LI);
+        MemoryUseOrDef *MCAccess = MSSA->getMemoryAccess(&MC);
+        // Unreachable blocks have no accesses
+        if (Access != nullptr && MCAccess != nullptr) {
+            MSSAU->createMemoryAccessBefore(SrcLI, MCAccess, Access);
+        }
+    }
+    return SrcLI;
+}
+
+
+/**
+ * @brief Eliminates redundant store instructions from the given LLVM function.
+ * 
+ * This function iterates over the basic blocks of the function queued in the
+ * worklist, and identifies and eliminates redundant store instructions.
+ * Redundant store instructions are those overwritten by a later store to the same
+ * address, or by a memset or memcpy that writes all of their bytes, in the same
+ * basic block, with nothing in between that may read the address. Loads of the
+ * address in between get the stored value instead. Alias analysis decides which
+ * instructions in between may read or write the address.
+ *
+ * Each block is scanned once, front to back, keeping a table of the latest
+ * store to every address that nothing has read or overwritten yet. Loads and
+ * stores of the same address are matched against the table; any other
+ * instruction that may read or write memory drops exactly the entries whose
+ * memory it may access. Memsets and memcpys are kept as well until something
+ * may write their bytes (or the source of a memcpy), and a load within their
+ * bytes reads the memset value, or is replaced with a load from the source.
+ * 
+ * @param F Reference to the LLVM function to eliminate redundant stores from.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function being optimized.
+ */
+static void EliminateRedundantStores(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Eliminate redundant stores start\n");
+
+    // Iterate over all queued basic blocks in the function
+    for (BasicBlock &BB : F) {
+        if (!WL.isQueued(&BB)) {
+            continue;
+        }
+
+        SmallSetVector<Instruction*, 16> toEraseRedundantLoads;
+        // Loads of a memcpy destination replaced with the same load of the source
+        std::vector<Instruction*> toEraseMovedLoads;
+        std::vector<Instruction*> toEraseRedundantStores;
+        BatchAAResults AA(AM.getAAResults());
+        const DataLayout &DL = F.getParent()->getDataLayout();
+        BlockAccessTable<StoreInst> pendingStores(DL);
+        // Memsets and memcpys whose bytes are still in memory
+        std::vector<MemIntrinsic*> pendingMemOps;
+
+        // Iterate over all instructions in the basic block
+        for (Instruction &I : BB) {
+            if (!I.mayReadOrWriteMemory()) {
+                continue;
+            }
+            Value *Ptr = getLoadStorePointerOperand(&I);
+            std::optional<PointerAddress> PtrAddr;
+            if (Ptr != nullptr) {
+                PtrAddr = getPointerAddress(Ptr, DL);
+            }
+            MemIntrinsic *MI = getForwardableMemIntrinsic(I);
+
+            pendingStores.removeIf(I, [&](StoreInst *SI) {
+                if (PtrAddr && getPointerAddress(SI->getPointerOperand(), DL) == *PtrAddr) {
+                    LoadInst *LIR = dyn_cast<LoadInst>(&I);
+                    StoreInst *SIR = dyn_cast<StoreInst>(&I);
+
+                    // Check if the load matches the pending store
+                    if (LIR != nullptr &&
+                        isReplaceableLoad(*LIR, SI->getOrdering()) &&              // load may take the stored value
+                        (LIR->getType() == SI->getValueOperand()->getType())) {    // loads the same type of operand
+                        DEBUG_PRINT("redundant load found\n");
+                        debugPrintLLVMInstr(*LIR);
+                        replaceInstruction(LIR, SI->getValueOperand(), WL);
+                        toEraseRedundantLoads.insert(LIR);
+                        return false;
+                    }
+
+                    // Check if the stores are redundant
+                    if (SIR != nullptr &&
+                        SI->isUnordered() &&                                                        // pending store orders nothing
+                        !isStrongerThan(SI->getOrdering(), SIR->getOrdering()) &&                   // and is not more atomic
+                        (SIR->getValueOperand()->getType() == SI->getValueOperand()->getType())) {  // stores the same type of operand
+                        DEBUG_PRINT("redundant store found\n");
+                        debugPrintLLVMInstr(*SIR);
+                        toEraseRedundantStores.push_back(SI);
+                        return true;
+                    }
+                }
+
+                // Check if a memset or memcpy overwrites the whole store without reading it
+                ModRefInfo MR = AA.getModRefInfo(&I, MemoryLocation::get(SI));
+                int64_t Offset;
+                if (MI != nullptr && SI->isSimple() && !isRefSet(MR) &&
+                    isWithinMemIntrinsic(SI->getPointerOperand(), DL.getTypeStoreSize(SI->getValueOperand()->getType()),
+                                         *MI, DL, Offset)) {
+                    DEBUG_PRINT("store overwritten by memory intrinsic found\n");
+                    debugPrintLLVMInstr(*SI);
+                    toEraseRedundantStores.push_back(SI);
+                    return true;
+                }
+
+                // Forget the store once something may read or change the stored value
+                return isModOrRefSet(MR);
+            });
+
+            // Check if the load reads bytes a memset or memcpy wrote
+            LoadInst *LI = dyn_cast<LoadInst>(&I);
+            if (LI != nullptr && LI->isSimple() && !toEraseRedundantLoads.count(LI) && !pendingMemOps.empty()) {
+                for (MemIntrinsic *Prior : pendingMemOps) {
+                    if (Value *V = getMemIntrinsicValue(*Prior, *LI, DL, WL)) {
+                        DEBUG_PRINT("load from memory intrinsic found\n");
+                        debugPrintLLVMInstr(*LI);
+                        replaceInstruction(LI, V, WL);
+                        if (isa<MemCpyInst>(Prior)) {
+                            toEraseMovedLoads.push_back(LI);
+                        } else {
+                            toEraseRedundantLoads.insert(LI);
                         }
+                        break;
                     }
                 }
             }
 
-            // Erase instructions marked for elimination
-            if (toEraseCSE.size() > 0) {
-                for (Instruction *I : toEraseCSE) {
-                    // Check if the instruction's parent is not null before erasing it
-                    if (I->getParent()) {
-                        DEBUG_PRINT("erasing CSE instruction: \n\t");
-                        debugPrintLLVMInstr(*I);
-                        DEBUG_PRINT("\n");
-                        I->eraseFromParent();
-                        CSEElim++;
-                    }
+            // Forget the memsets and memcpys whose bytes or source this instruction may change
+            if (I.mayWriteToMemory()) {
+                erase_if(pendingMemOps, [&](MemIntrinsic *Prior) {
+                    MemCpyInst *MC = dyn_cast<MemCpyInst>(Prior);
+                    return isModSet(AA.getModRefInfo(&I, MemoryLocation::getForDest(Prior))) ||
+                           (MC != nullptr && isModSet(AA.getModRefInfo(&I, MemoryLocation::getForSource(MC))));
+                });
+            }
+
+            if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+                pendingStores.insert(SI);
+            } else if (MI != nullptr) {
+                pendingMemOps.push_back(MI);
+            }
+        }
+
+        // Erase redundant loads and stores
+        if (toEraseRedundantLoads.size() > 0) {
+            for (Instruction *redload : toEraseRedundantLoads) {
+                DEBUG_PRINT("erasing redundant load: \n\t");
+                debugPrintLLVMInstr(*redload);
+                DEBUG_PRINT("\n");
+                eraseInstruction(redload, WL);
+                CSEStore2Load++;
+            }
+        }
+        for (Instruction *movedload : toEraseMovedLoads) {
+            DEBUG_PRINT("erasing load moved to memcpy source: \n\t");
+            debugPrintLLVMInstr(*movedload);
+            DEBUG_PRINT("\n");
+            eraseInstruction(movedload, WL);
+        }
+        if (toEraseRedundantStores.size() > 0) {
+            for (Instruction *redstore : toEraseRedundantStores) {
+                DEBUG_PRINT("erasing redundant store: \n\t");
+                debugPrintLLVMInstr(*redstore);
+                DEBUG_PRINT("\n");
+                eraseInstruction(redstore, WL);
+                CSEStElim++;
+            }
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------
+//                      Optimization 5: Cross-Block Load Elimination (-memssa-loads)
+// --------------------------------------------------------------------------------
+/**
+ * @brief Eliminates loads made redundant by a load or store in a dominating block.
+ *
+ * MemorySSA gives the access that last clobbered the memory each load reads,
+ * across block boundaries. If that access is a store to the same address, the
+ * stored value is forwarded to the load. Otherwise the load is replaced by an
+ * earlier load of the same address and type that dominates it, provided the
+ * clobbering access also dominates that earlier load, so no write can happen
+ * between the two. Blocks are visited in dominator tree preorder, so every
+ * dominating load has been seen before the loads it dominates.
+ *
+ * @param F Reference to the LLVM function to be optimized.
+ * @param WL The worklist of the function being optimized.
+ * @param AM The analyses cached for the function being optimized.
+ */
+static void EliminateCrossBlockLoads(Function &F, CSEWorklist &WL, CSEAnalyses &AM) {
+    DEBUG_PRINT("Eliminate cross-block loads start\n");
+
+    // Inside opt, a MemorySSA left by an earlier pass has not seen what was erased before the updater was registered
+    if (WL.madeChanges() && !WL.getMemorySSAUpdater()) {
+        AM.invalidateMemorySSA();
+    }
+    DominatorTree &DT = AM.getDomTree();
+    MemorySSA &MSSA = AM.getMemorySSA();
+    MemorySSAWalker *Walker = MSSA.getWalker();
+    WL.setMemorySSAUpdater(&AM.getMemorySSAUpdater());
+
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    // Loads that stay in the function, by address and type
+    DenseMap<std::pair<PointerAddress, Type*>, SmallVector<LoadInst*, 2>> AvailableLoads;
+
+    for (DomTreeNode *Node : depth_first(DT.getRootNode())) {
+        BasicBlock *BB = Node->getBlock();
+        for (Instruction &I : llvm::make_early_inc_range(*BB)) {
+            LoadInst *LI = dyn_cast<LoadInst>(&I);
+            if (!LI || !LI->isUnordered()) {
+                continue;
+            }
+            PointerAddress Addr = getPointerAddress(LI->getPointerOperand(), DL);
+            auto &Candidates = AvailableLoads[{Addr, LI->getType()}];
+            if (!WL.isQueued(BB)) {
+                Candidates.push_back(LI);
+                continue;
+            }
+
+            MemoryAccess *Clobber = Walker->getClobberingMemoryAccess(LI);
+
+            // Forward the value of the store that last wrote the address
+            if (MemoryDef *Def = dyn_cast<MemoryDef>(Clobber)) {
+                StoreInst *SI = dyn_cast_or_null<StoreInst>(Def->getMemoryInst());
+                if (SI && SI->isUnordered() && isReplaceableLoad(*LI, SI->getOrdering()) &&
+                    getPointerAddress(SI->getPointerOperand(), DL) == Addr &&
+                    SI->getValueOperand()->getType() == LI->getType()) {
+                    DEBUG_PRINT("store forwarded across blocks\n");
+                    debugPrintLLVMInstr(*LI);
+                    replaceInstruction(LI, SI->getValueOperand(), WL);
+                    eraseInstruction(LI, WL);
+                    CSEStore2Load++;
+                    continue;
+                }
+            }
+
+            // Reuse a dominating load that reads the same memory state
+            LoadInst *Leader = nullptr;
+            for (LoadInst *Prior : Candidates) {
+                if (isReplaceableLoad(*LI, Prior->getOrdering()) && DT.dominates(Prior, LI) &&
+                    MSSA.dominates(Clobber, MSSA.getMemoryAccess(Prior))) {
+                    Leader = Prior;
+                    break;
                 }
             }
+            if (Leader) {
+                DEBUG_PRINT("redundant load found across blocks\n");
+                debugPrintLLVMInstr(*LI);
+                replaceInstruction(LI, Leader, WL);
+                eraseInstruction(LI, WL);
+                CSELdElim++;
+            } else {
+                Candidates.push_back(LI);
+            }
         }
     }
 
-    DEBUG_PRINT("CSE end\n");
+    DEBUG_PRINT("Eliminate cross-block loads end\n");
 }
 
 // --------------------------------------------------------------------------------
-//                      Optimization 3: Eliminate Redundant Loads
+//                      Call all optimizations here
 // --------------------------------------------------------------------------------
 /**
- * @brief Checks if there are no intervening store or call instructions between two load instructions.
- * 
- * This function checks if there are no store or call instructions between the currentLoad and nextLoad
- * within the same basic block.
- * 
- * @param currentLoad Pointer to the current load instruction.
- * @param nextLoad Pointer to the next load instruction.
- * @return true if there are no intervening store or call instructions, false otherwise.
- */
-static bool noInterveningStoresOrCalls(LoadInst *currentLoad, LoadInst *nextLoad) {
-    BasicBlock *PBB = currentLoad->getParent();
-    bool retVal = true;
-
-    // Iterate over instructions starting from the instruction after currentLoad
-    for (BasicBlock::iterator I = std::next(currentLoad->getIterator()); 
-         (I != PBB->end()) && (&*I != nextLoad); 
-         I++) {
-        // Check if the instruction is a store or call
-        if (I->getOpcode() == Instruction::Store || 
-            I->getOpcode() == Instruction::Call) {
-            retVal = false;
-            break;
+ * @brief Cheaply checks whether the first sweep could change the given function.
+ *
+ * The function needs the full pipeline if it has a dead or simplifiable
+ * instruction, two CSE candidates with the same hash, an expression tree that
+ * is not in the canonical order, a block that makes two calls with the same
+ * hash that only read memory, a block that loads or stores the same
+ * pointer twice (with -memssa-loads, a function that does), or a block where
+ * a memset or memcpy and a load or store access the same base pointer. If none of these
+ * holds, the first sweep would not change anything, so skipping it gives the
+ * same result.
+ *
+ * @param F Reference to the LLVM function to be checked.
+ * @param AM The analyses cached for the function, whose fingerprints CSE reuses afterwards.
+ * @return true if the function has to go through the optimizations.
+ */
+static bool hasOptimizationCandidates(Function &F, CSEAnalyses &AM) {
+    CSEFingerprintCache &FP = AM.getFingerprints();
+    const SimplifyQuery Q = AM.getSimplifyQuery();
+    DenseSet<unsigned> ExprHashes;
+    // Roots of expression trees that reassociation may reorder. Once no two CSE
+    // candidates share a fingerprint, no node is shared with another one either
+    std::vector<Instruction*> TreeRoots;
+    auto NoneShared = [](Instruction *) { return false; };
+
+    // With -memssa-loads a load may be redundant with an access in any other block,
+    // which need not come before it in layout order
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    DenseSet<PointerAddress> FunctionPointers;
+    for (BasicBlock &BB : F) {
+        // Addresses as the load and store handling splits them into base and offset
+        DenseSet<PointerAddress> Pointers;
+        DenseSet<unsigned> CallHashes;
+        // Base pointers of the addresses the memsets and memcpys may cover
+        SmallPtrSet<const Value*, 8> AccessedBases;
+        SmallPtrSet<const Value*, 8> MemOpBases;
+        auto getBase = [&DL](Value *Ptr) { return getPointerAddress(Ptr, DL).first; };
+        for (Instruction &I : BB) {
+            if (isDead(I)) {
+                return true;
+            }
+            if (MemIntrinsic *MI = getForwardableMemIntrinsic(I)) {
+                if (AccessedBases.count(getBase(MI->getDest()))) {
+                    return true;
+                }
+                MemOpBases.insert(getBase(MI->getDest()));
+            } else if (Value *Ptr = getLoadStorePointerOperand(&I)) {
+                if (MemOpBases.count(getBase(Ptr))) {
+                    return true;
+                }
+                AccessedBases.insert(getBase(Ptr));
+            }
+            if (isMergeableCall(I) && !isReadNoneCall(I) && !CallHashes.insert(FP.get(&I)).second) {
+                return true;
+            }
+            if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+                PointerAddress Addr = getPointerAddress(LI->getPointerOperand(), DL);
+                if (!Pointers.insert(Addr).second) {
+                    return true;
+                }
+                if (MemSSALoads && !FunctionPointers.insert(Addr).second) {
+                    return true;
+                }
+            } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+                PointerAddress Addr = getPointerAddress(SI->getPointerOperand(), DL);
+                if (MemSSALoads && !FunctionPointers.insert(Addr).second) {
+                    return true;
+                }
+                if (!Pointers.insert(Addr).second) {
+                    return true;
+                }
+            } else if (isCSECandidate(I) && !ExprHashes.insert(FP.get(&I)).second) {
+                return true;
+            }
+            if (isReassociationRoot(I, NoneShared)) {
+                TreeRoots.push_back(&I);
+            }
+        }
+
+        // Folding may create constants in the shared context, so the block is tried under one lock
+        std::lock_guard<std::mutex> Lock(ContextMutex);
+        for (Instruction &I : BB) {
+            if (simplifyInstruction(&I, Q.getWithInstruction(&I))) {
+                return true;
+            }
+        }
+    }
+
+    // The ranks are only computed once a tree is large enough to be reordered
+    std::optional<CSEExpressionRanks> Ranks;
+    for (Instruction *Root : TreeRoots) {
+        SmallVector<Value*, 8> Leaves;
+        SmallVector<Instruction*, 8> Nodes;
+        bool Linear = collectExpressionTree(*Root, Leaves, Nodes, NoneShared);
+        if (Leaves.size() < 3) {
+            continue;
+        }
+        if (!Ranks) {
+            Ranks.emplace(F);
+        }
+        if (!isCanonicalTree(Leaves, Linear, *Ranks)) {
+            return true;
         }
     }
-    return retVal;
+    return false;
 }
 
 
 /**
- * @brief Eliminates redundant load instructions within each function in the LLVM module.
- * 
- * This function iterates over all functions in the module and within each function, it
- * iterates over all basic blocks to identify and eliminate redundant load instructions.
- * A load instruction is considered redundant if there is another load instruction later
- * in the same basic block that loads the same address, has the same type of operand, and
- * has no intervening store or call instructions between them.
- * 
- * @param M Pointer to the LLVM module to eliminate redundant loads from.
+ * @brief Runs all optimizations on the given LLVM function.
+ *
+ * The function starts with all of its instructions queued. A sweep runs every
+ * optimization over the queued work, and the function is swept again only
+ * while the previous sweep queued users or operands of something it replaced
+ * or erased, so untouched functions cost a single sweep and longer cascades
+ * are still followed to the end. Reassociation only runs in a sweep that left
+ * nothing else to do, and the sweeps continue if it rebuilt a tree.
+ *
+ * @param F Reference to the LLVM function to be optimized.
+ * @param AM The analyses cached for the function.
+ * @return true if the function was changed, false otherwise.
  */
-static void EliminateRedundantLoads(Module *M) {
-    DEBUG_PRINT("Eliminate redundant loads start\n");
+static bool optimizeFunction(Function &F, CSEAnalyses &AM) {
+    // Marked calls turn into candidates, so this comes before looking for any
+    bool MarkedCalls = NoMathErrno && MarkMathLibCalls(F, AM);
 
-    // Iterate over all functions in the module
-    for (Function &F : *M) {
-        // Iterate over all basic blocks in the function
-        for (BasicBlock &BB : F) {
-            // Vector to collect redundant loads within the basic block
-            std::vector<Instruction*> toEraseRedundantLoads;
-            bool moveToNextLoad = false;
+    // Whether an instruction is live is only known once the whole function is marked
+    if (!AggressiveDCE && !hasOptimizationCandidates(F, AM)) {
+        DEBUG_PRINT(" ----- " << F.getName() << " has nothing to optimize" << "\n");
+        return MarkedCalls;
+    }
 
-            // Iterate over all instructions in the basic block
-            for (Instruction &I : BB) {
-                // Check if the instruction is a load
-                if (I.getOpcode() == Instruction::Load) {
-                    LoadInst *LI = dyn_cast<LoadInst>(&I);
-                    
-                    // Iterate over all instructions after I in the basic block
-                    for (Instruction &J : llvm::make_range(std::next(I.getIterator()), BB.end())) {
-                        // Check if J is a store instruction
-                        if (J.getOpcode() == Instruction::Store) {
-                            moveToNextLoad = true;
-                            break;
-                        }
-                        // Check if J is a load instruction
-                        if (J.getOpcode() == Instruction::Load) {
-                            LoadInst *LJ = dyn_cast<LoadInst>(&J);
-                            // Check if LI and LJ are identical and there are no intervening stores or calls
-                            // if (
-                            if ( 
-                                LJ != nullptr &&
-                                (!LJ->isVolatile()) &&
-                                (LJ->getPointerOperand() == LI->getPointerOperand()) &&
-                                (LJ->getType() == LI->getType()) &&
-                                (noInterveningStoresOrCalls(LI, LJ))
-                               ) {
-                                    DEBUG_PRINT("redundant load found\n");
-                                    debugPrintLLVMInstr(*LJ);
-                                    // Replace uses of LJ with LI and mark LJ for erasing
-                                    LJ->replaceAllUsesWith(LI);
-                                    toEraseRedundantLoads.push_back(LJ);
-                            }
-                        }
-                    }
-                    if (moveToNextLoad) {
-                        continue;
-                    }
-                }
-            }
-            
-            // Eliminate collected redundant loads and update the counter
-            if (toEraseRedundantLoads.size() > 0) {
-                for (Instruction *redload : toEraseRedundantLoads) {
-                    if (redload->getParent()) {
-                        DEBUG_PRINT("erasing redundant load: \n\t");
-                        debugPrintLLVMInstr(*redload);
-                        redload->eraseFromParent();
-                        CSELdElim++;
-                    }
-                }
+    CSEWorklist WL;
+    WL.seed(F);
+#if DEBUG_PRINT_EN
+    int iteration = 1;
+#endif
+    do {
+        DEBUG_PRINT(" ----- " << F.getName() << " iteration: " << iteration++ << "------" << "\n");
+        if (AggressiveDCE) {
+            AggressiveDeadCodeElimination(F, WL, AM);
+        } else {
+            DeadCodeElimination(F, WL);
+        }
+        SimplifyInstructions(F, WL, AM);
+        performCSE(WL, AM);
+        EliminateRedundantLoads(F, WL, AM);
+        EliminateRedundantStores(F, WL, AM);
+        if (MemSSALoads) {
+            EliminateCrossBlockLoads(F, WL, AM);
+        }
+        // Partial results may only turn out equal once the rest settles, reassociating earlier takes them apart
+        if (!WL.hasNext()) {
+            ReassociateExpressions(F, WL, AM);
+        }
+    } while (WL.advance());
+    return WL.madeChanges() || MarkedCalls;
+}
+
+
+/**
+ * @brief Runs all optimizations on every function of the given LLVM module.
+ *
+ * Functions are optimized independently of each other, so with -j N they are
+ * handed to a pool of N threads. Changes to the shared context are serialized
+ * through ContextMutex, and the result does not depend on the order in which
+ * the functions finish.
+ *
+ * @param M Pointer to the LLVM module to be optimized.
+ * @param Reused Functions that already hold their optimized body from a previous run.
+ */
+#ifndef P2_PLUGIN
+static void CommonSubexpressionElimination(Module *M, const SmallPtrSetImpl<Function*> &Reused) {
+    // Shared read-only by all functions, only their attribute overrides are per function
+    TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+
+    if (Jobs <= 1) {
+        for (Function &F : *M) {
+            if (!F.empty() && !Reused.count(&F)) {
+                CSEAnalyses AM(F, TLII);
+                optimizeFunction(F, AM);
             }
         }
+        return;
     }
 
-    DEBUG_PRINT("Eliminate redundant loads end\n");
+    // The data layout computes struct layouts on first use and caches them unsynchronized
+    TypeFinder StructTypes;
+    StructTypes.run(*M, /*onlyNamed=*/false);
+    for (StructType *ST : StructTypes) {
+        if (ST->isSized()) {
+            M->getDataLayout().getStructLayout(ST);
+        }
+    }
+
+    ThreadPool Pool(hardware_concurrency(Jobs));
+    for (Function &F : *M) {
+        if (!F.empty() && !Reused.count(&F)) {
+            Pool.async([&F, &TLII] {
+                CSEAnalyses AM(F, TLII);
+                optimizeFunction(F, AM);
+            });
+        }
+    }
+    Pool.wait();
 }
+#endif // P2_PLUGIN
 
+#ifndef P2_PLUGIN
 // --------------------------------------------------------------------------------
-//                      Optimization 4: Eliminate Redundant Stores
+//                      Optimization 6: Function Attribute Inference (-infer-attrs)
 // --------------------------------------------------------------------------------
+
+static llvm::Statistic CSEInferMem = {"", "CSEInferMem", "CSE functions given narrower memory effects"};
+static llvm::Statistic CSEInferNoCapture = {"", "CSEInferNoCapture", "CSE arguments found not captured"};
+
 /**
- * @brief Eliminates redundant store instructions from the given LLVM module.
- * 
- * This function iterates over all functions in the module and within each function's
- * basic blocks, it identifies and eliminates redundant store instructions.
- * Redundant store instructions are those that store the same value to the same memory
- * address as another store instruction earlier in the same basic block.
- * 
- * @param M Pointer to the LLVM module to eliminate redundant stores from.
+ * @brief Adds an access to the memory behind a pointer to the memory effects of a function.
+ *
+ * The callers cannot see the allocas of the function, nor a read of a constant
+ * global. Memory reached through an argument is argument memory, and a pointer
+ * of unknown origin may point to argument memory as well as any other memory.
+ *
+ * @param ME The memory effects of the function found so far.
+ * @param Ptr The pointer that is accessed.
+ * @param MR Whether the memory is read, written or both.
  */
-static void EliminateRedundantStores(Module *M) {
-    DEBUG_PRINT("Eliminate redundant stores start\n");
+static void addMemoryAccess(MemoryEffects &ME, const Value *Ptr, ModRefInfo MR) {
+    const Value *Obj = getUnderlyingObject(Ptr);
+    if (isa<AllocaInst>(Obj)) {
+        return;
+    }
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Obj)) {
+        if (GV->isConstant() && !isModSet(MR)) {
+            return;
+        }
+    }
+    if (isa<Argument>(Obj)) {
+        ME |= MemoryEffects::argMemOnly(MR);
+        return;
+    }
+    if (!isIdentifiedObject(Obj)) {
+        ME |= MemoryEffects::argMemOnly(MR);
+    }
+    ME |= MemoryEffects(IRMemLocation::Other, MR);
+}
 
-    // Iterate over all functions in the module
-    for (Function &F : *M) {
-        // Iterate over all basic blocks in the function
-        for (BasicBlock &BB : F) {
-            std::vector<Instruction*> toEraseRedundantLoads;
-            std::vector<Instruction*> toEraseRedundantStores;
-            bool moveToNextStore = false;
-            bool redInstrFound = false;
 
-            // Iterate over all instructions in the basic block
-            for (Instruction &I : BB) {
-                // Check if the instruction is a store
-                if (I.getOpcode() == Instruction::Store) {
-                    StoreInst *SI = dyn_cast<StoreInst>(&I);
-
-                    // Iterate over instructions after the current store in the basic block
-                    for (Instruction &R : llvm::make_range(std::next(I.getIterator()), BB.end())) {
-                        // Check if the next instruction is a load
-                        if (R.getOpcode() == Instruction::Load) {
-                            LoadInst *LIR = dyn_cast<LoadInst>(&R);
-
-                            // Check if the load matches the current store
-                            if ((!LIR->isVolatile()) &&                                    // load is not volatile
-                                (LIR->getPointerOperand() == SI->getPointerOperand()) &&   // loads the same address
-                                (LIR->getType() == SI->getValueOperand()->getType())) {    // loads the same type of operand
-                                DEBUG_PRINT("redundant load found\n");
-                                debugPrintLLVMInstr(*LIR);
-                                LIR->replaceAllUsesWith(SI->getValueOperand());
-                                toEraseRedundantLoads.push_back(LIR);
-                                redInstrFound = true;
-                            }
-                        }
-                        // Check if the next instruction is a store
-                        else if (R.getOpcode() == Instruction::Store) {
-                            StoreInst *SIR = dyn_cast<StoreInst>(&R);
-
-                            // Check if the stores are redundant
-                            if ((!SI->isVolatile()) &&                                                      // current store is not volatile
-                                (SIR->getPointerOperand() == SI->getPointerOperand()) &&                    // stores the same address
-                                (SIR->getValueOperand()->getType() == SI->getValueOperand()->getType())) {  // stores the same type of operand
-                                DEBUG_PRINT("redundant store found\n");
-                                debugPrintLLVMInstr(*SIR);
-                                toEraseRedundantStores.push_back(SI);
-                                redInstrFound = true;
-                                moveToNextStore = true;
-                                break;
-                            }
-                        }
-                        if (!redInstrFound) {
-                            // Check if the next instruction is a call
-                            if (isSideEffectInstruction(R)) {
-                                moveToNextStore = true;
-                                break;
-                            }
-                        }
+/**
+ * @brief Computes what a function may do to the memory its callers can see.
+ *
+ * Calls to a function of the same SCC are left out, since the effects of that
+ * function are added when its own body is scanned. The pointers passed to
+ * them are collected instead: they are accessed however the SCC accesses its
+ * argument memory, which is only known once every body has been scanned.
+ *
+ * @param F The function to scan.
+ * @param SCC The functions of the SCC that F belongs to.
+ * @param RecursiveArgs Collects the pointers passed to calls within the SCC.
+ * @return The memory effects of F.
+ */
+static MemoryEffects computeMemoryEffects(Function &F, const SmallPtrSetImpl<Function*> &SCC,
+                                          SmallVectorImpl<const Value*> &RecursiveArgs) {
+    MemoryEffects ME = MemoryEffects::none();
+    for (Instruction &I : instructions(F)) {
+        if (!I.mayReadOrWriteMemory()) {
+            continue;
+        }
+        if (CallBase *CB = dyn_cast<CallBase>(&I)) {
+            Function *Callee = CB->getCalledFunction();
+            if (Callee != nullptr && SCC.count(Callee)) {
+                for (Value *Arg : CB->args()) {
+                    if (Arg->getType()->isPtrOrPtrVectorTy()) {
+                        RecursiveArgs.push_back(Arg);
                     }
-
-                    // Move to the next store if needed
-                    if (moveToNextStore) {
-                        continue;
+                }
+                continue;
+            }
+            // The argument memory of the callee is whatever the pointers passed to it point to
+            MemoryEffects CallME = CB->getMemoryEffects();
+            ME |= CallME.getWithoutLoc(IRMemLocation::ArgMem);
+            ModRefInfo ArgMR = CallME.getModRef(IRMemLocation::ArgMem);
+            if (ArgMR != ModRefInfo::NoModRef) {
+                for (Value *Arg : CB->args()) {
+                    if (Arg->getType()->isPtrOrPtrVectorTy()) {
+                        addMemoryAccess(ME, Arg, ArgMR);
                     }
                 }
             }
+            continue;
+        }
+        // Volatile and atomic accesses order other memory too, so only plain ones are narrowed
+        if (LoadInst *LI = dyn_cast<LoadInst>(&I); LI != nullptr && LI->isSimple()) {
+            addMemoryAccess(ME, LI->getPointerOperand(), ModRefInfo::Ref);
+        } else if (StoreInst *SI = dyn_cast<StoreInst>(&I); SI != nullptr && SI->isSimple()) {
+            addMemoryAccess(ME, SI->getPointerOperand(), ModRefInfo::Mod);
+        } else {
+            return MemoryEffects::unknown();
+        }
+    }
+    return ME;
+}
 
-            // Erase redundant loads and stores
-            if (toEraseRedundantLoads.size() > 0) {
-                for (Instruction *redload : toEraseRedundantLoads) {
-                    DEBUG_PRINT("erasing redundant load: \n\t");
-                    debugPrintLLVMInstr(*redload);
-                    DEBUG_PRINT("\n");
-                    redload->eraseFromParent();
-                    CSEStore2Load++;
-                }
+
+/**
+ * @brief Infers the memory effects and nocapture arguments of every defined function.
+ *
+ * The call graph is walked bottom-up by SCC, so the attributes found for a
+ * callee are used when its callers are scanned. The functions of an SCC call
+ * each other, so they all get the union of their effects. An SCC with a
+ * function whose body may be replaced at link time is left alone. Callers
+ * that end up with memory(none) or memory(read) calls let CSE and the
+ * load/store optimizations see past those calls.
+ *
+ * @param M Reference to the LLVM module.
+ */
+static void InferFunctionAttributes(Module &M) {
+    CallGraph CG(M);
+    for (scc_iterator<CallGraph*> It = scc_begin(&CG); !It.isAtEnd(); ++It) {
+        SmallVector<Function*, 4> Functions;
+        SmallPtrSet<Function*, 4> SCC;
+        bool Known = true;
+        for (CallGraphNode *Node : *It) {
+            Function *F = Node->getFunction();
+            if (F == nullptr || F->isDeclaration()) {
+                continue;
+            }
+            if (F->isInterposable() || F->hasFnAttribute(Attribute::Naked)) {
+                Known = false;
+                break;
+            }
+            Functions.push_back(F);
+            SCC.insert(F);
+        }
+        if (!Known || Functions.empty()) {
+            continue;
+        }
+
+        MemoryEffects ME = MemoryEffects::none();
+        SmallVector<const Value*, 8> RecursiveArgs;
+        for (Function *F : Functions) {
+            ME |= computeMemoryEffects(*F, SCC, RecursiveArgs);
+        }
+        // Adding these cannot change how argument memory is accessed, so one pass is enough
+        ModRefInfo ArgMR = ME.getModRef(IRMemLocation::ArgMem);
+        if (ArgMR != ModRefInfo::NoModRef) {
+            for (const Value *Arg : RecursiveArgs) {
+                addMemoryAccess(ME, Arg, ArgMR);
+            }
+        }
+        for (Function *F : Functions) {
+            MemoryEffects OldME = F->getMemoryEffects();
+            if ((OldME & ME) != OldME) {
+                DEBUG_PRINT("Inferred memory effects of " << F->getName() << "\n");
+                F->setMemoryEffects(OldME & ME);
+                CSEInferMem++;
             }
-            if (toEraseRedundantStores.size() > 0) {
-                for (Instruction *redstore : toEraseRedundantStores) {
-                    DEBUG_PRINT("erasing redundant store: \n\t");
-                    debugPrintLLVMInstr(*redstore);
-                    DEBUG_PRINT("\n");
-                    redstore->eraseFromParent();
-                    CSEStElim++;
+        }
+
+        // Capture tracking looks at the nocapture arguments of the callees, which are done by now
+        for (Function *F : Functions) {
+            for (Argument &A : F->args()) {
+                if (A.getType()->isPointerTy() && !A.hasNoCaptureAttr() &&
+                    !PointerMayBeCaptured(&A, /*ReturnCaptures=*/true, /*StoreCaptures=*/true)) {
+                    A.addAttr(Attribute::NoCapture);
+                    CSEInferNoCapture++;
                 }
             }
         }
     }
 }
+#endif // P2_PLUGIN
+
 
+#ifdef P2_PLUGIN
 // --------------------------------------------------------------------------------
-//                      Call all optimizations here
+//                      New Pass Manager plugin
 // --------------------------------------------------------------------------------
-static void CommonSubexpressionElimination(Module *M) {
-    int i = 3;
-    while (i > 0) {
-        DEBUG_PRINT(" ----- iteration: " << (4 - i) << "------" << "\n");
-        DeadCodeElimination(M);
-        SimplifyInstructions(M);
-        performCSE(M);
-        EliminateRedundantLoads(M);
-        EliminateRedundantStores(M);
-        i--;
-    }
-}
\ No newline at end of file
+/**
+ * @brief Returns the analyses kept valid by an optimization of a function.
+ *
+ * Only the aggressive DCE changes the CFG, so a function changed by any other
+ * optimization still preserves the CFG analyses. CFG changes are made through
+ * the updater of CSEAnalyses, which keeps the dominator tree up to date.
+ *
+ * @param Changed Whether the optimization changed the function.
+ * @param CFGChanged Whether the optimization removed edges or blocks.
+ * @return The preserved analyses to report to the pass manager.
+ */
+static PreservedAnalyses getPreservedAnalyses(bool Changed, bool CFGChanged = false) {
+    if (!Changed) {
+        return PreservedAnalyses::all();
+    }
+    PreservedAnalyses PA;
+    if (CFGChanged) {
+        PA.preserve<DominatorTreeAnalysis>();
+    } else {
+        PA.preserveSet<CFGAnalyses>();
+    }
+    return PA;
+}
+
+
+/**
+ * @brief Runs a single optimization on the given function until it stops changing it.
+ *
+ * @param F Reference to the LLVM function to be optimized.
+ * @param Optimization The optimization to be run.
+ * @return true if the function was changed, false otherwise.
+ */
+static bool runToFixpoint(Function &F, function_ref<void(CSEWorklist &)> Optimization) {
+    CSEWorklist WL;
+    WL.seed(F);
+    do {
+        Optimization(WL);
+    } while (WL.advance());
+    return WL.madeChanges();
+}
+
+
+/**
+ * @brief Runs all optimizations, as the p2 tool does (-passes=p2).
+ */
+struct CSEPipelinePass : PassInfoMixin<CSEPipelinePass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        // Analyses are only requested once an optimization needs them
+        CSEAnalyses AM(F, FAM);
+        bool Changed = optimizeFunction(F, AM);
+        return getPreservedAnalyses(Changed, AM.changedCFG());
+    }
+};
+
+/**
+ * @brief Optimization 0 on its own (-passes=p2-dce).
+ */
+struct CSEDeadCodeEliminationPass : PassInfoMixin<CSEDeadCodeEliminationPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &) {
+        return getPreservedAnalyses(runToFixpoint(F, [&F](CSEWorklist &WL) { DeadCodeElimination(F, WL); }));
+    }
+};
+
+/**
+ * @brief The liveness based variant of optimization 0 on its own (-passes=p2-adce).
+ */
+struct CSEAggressiveDeadCodeEliminationPass : PassInfoMixin<CSEAggressiveDeadCodeEliminationPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        bool Changed = runToFixpoint(F, [&](CSEWorklist &WL) { AggressiveDeadCodeElimination(F, WL, AM); });
+        return getPreservedAnalyses(Changed, AM.changedCFG());
+    }
+};
+
+/**
+ * @brief Optimization 1 on its own (-passes=p2-simplify).
+ */
+struct CSESimplifyPass : PassInfoMixin<CSESimplifyPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { SimplifyInstructions(F, WL, AM); }));
+    }
+};
+
+/**
+ * @brief Reassociation on its own (-passes=p2-reassociate).
+ */
+struct CSEReassociatePass : PassInfoMixin<CSEReassociatePass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { ReassociateExpressions(F, WL, AM); }));
+    }
+};
+
+/**
+ * @brief Optimization 2 on its own (-passes=p2-cse).
+ */
+struct CSEPass : PassInfoMixin<CSEPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { performCSE(WL, AM); }));
+    }
+};
+
+/**
+ * @brief Optimization 3 on its own (-passes=p2-loads).
+ */
+struct CSELoadEliminationPass : PassInfoMixin<CSELoadEliminationPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { EliminateRedundantLoads(F, WL, AM); }));
+    }
+};
+
+/**
+ * @brief Optimization 4 on its own (-passes=p2-stores).
+ */
+struct CSEStoreEliminationPass : PassInfoMixin<CSEStoreEliminationPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { EliminateRedundantStores(F, WL, AM); }));
+    }
+};
+
+
+/**
+ * @brief Optimization 5 on its own (-passes=p2-memssa-loads).
+ */
+struct CSECrossBlockLoadPass : PassInfoMixin<CSECrossBlockLoadPass> {
+    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+        CSEAnalyses AM(F, FAM);
+        return getPreservedAnalyses(runToFixpoint(F, [&](CSEWorklist &WL) { EliminateCrossBlockLoads(F, WL, AM); }));
+    }
+};
+
+
+/**
+ * @brief Adds the function pass named in an opt -passes= pipeline.
+ *
+ * @param Name The name of the pass in the pipeline.
+ * @param FPM The function pass manager the pass is added to.
+ * @return true if the name is one of the passes of this plugin, false otherwise.
+ */
+static bool parseCSEPipeline(StringRef Name, FunctionPassManager &FPM,
+                             ArrayRef<PassBuilder::PipelineElement>) {
+    if (Name == "p2") {
+        FPM.addPass(CSEPipelinePass());
+    } else if (Name == "p2-dce") {
+        FPM.addPass(CSEDeadCodeEliminationPass());
+    } else if (Name == "p2-adce") {
+        FPM.addPass(CSEAggressiveDeadCodeEliminationPass());
+    } else if (Name == "p2-simplify") {
+        FPM.addPass(CSESimplifyPass());
+    } else if (Name == "p2-reassociate") {
+        FPM.addPass(CSEReassociatePass());
+    } else if (Name == "p2-cse") {
+        FPM.addPass(CSEPass());
+    } else if (Name == "p2-loads") {
+        FPM.addPass(CSELoadEliminationPass());
+    } else if (Name == "p2-stores") {
+        FPM.addPass(CSEStoreEliminationPass());
+    } else if (Name == "p2-memssa-loads") {
+        FPM.addPass(CSECrossBlockLoadPass());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Entry point opt looks up when the plugin is loaded with -load-pass-plugin.
+ */
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return {LLVM_PLUGIN_API_VERSION, "p2", LLVM_VERSION_STRING, [](PassBuilder &PB) {
+        PB.registerPipelineParsingCallback(parseCSEPipeline);
+    }};
+}
+#endif // P2_PLUGIN
@@ -11,11 +11,9 @@ define i32 @cse1(ptr %0, ptr %1, ptr %2, i32 %3, i64 %4, i8 %5) {
 ; CHECK-NEXT: alloca
 ; CHECK-NEXT: store
 ; CHECK-NEXT: store
-; CHECK-NEXT: load
-; CHECK-NEXT: load
-; CHECK-NEXT: lshr
-; CHECK-NEXT: store
-; CHECK-NEXT: store
+; Alias analysis forwards both stores past each other, and lshr %3, %3 folds to 0
+; CHECK-NEXT: store i32 0
+; CHECK-NEXT: store i32 0
 ; CHECK-NEXT: ret i32
 BB:
   %A = alloca i32, align 4
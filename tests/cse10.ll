@@ -0,0 +1,36 @@
+; ModuleID = 'cse10'
+; CHECK-LABEL: source_filename = "cse10"
+source_filename = "cse10"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare double @sqrt(double)
+declare void @llvm.assume(i1)
+
+; sqrt is a known library function, so sqrt(4.0) folds to 2.0, and the
+; instructions using it fold right after in the same pass
+; CHECK-LABEL: @cse10(double %0) {
+define double @cse10(double %0) {
+; CHECK-NEXT: BB:
+; CHECK-NOT: fmul
+; CHECK-NOT: fdiv
+; CHECK: ret double %0
+BB:
+  %A = call double @sqrt(double 4.000000e+00)
+  %P = fmul double 5.000000e-01, %A
+  %R = fdiv double %0, %P
+  ret double %R
+}
+
+; The assumption decides the comparison
+; CHECK-LABEL: @cse10_assume(i32 %0) {
+define i1 @cse10_assume(i32 %0) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: %C = icmp eq i32 %0, 5
+; CHECK-NEXT: call void @llvm.assume(i1 %C)
+; CHECK-NEXT: ret i1 true
+BB:
+  %C = icmp eq i32 %0, 5
+  call void @llvm.assume(i1 %C)
+  %D = icmp eq i32 %0, 5
+  ret i1 %D
+}
@@ -0,0 +1,61 @@
+; ModuleID = 'cse11'
+; CHECK-LABEL: source_filename = "cse11"
+source_filename = "cse11"
+
+; Commutative operations match with their operands swapped, and compares match
+; with the operands and the predicate swapped. Instructions that only differ in
+; their flags match too, and the one kept only keeps the flags both have. sub is
+; not commutative.
+; CHECK-LABEL: @cse11(i32 %0, i32 %1, float %2, float %3, ptr %4) {
+define void @cse11(i32 %0, i32 %1, float %2, float %3, ptr %4) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: %A = add i32 %0, %1
+; CHECK-NEXT: store volatile i32 %A, ptr %4
+; CHECK-NEXT: store volatile i32 %A, ptr %4
+; CHECK-NEXT: store volatile i32 %A, ptr %4
+; CHECK-NEXT: %D = udiv i32 %0, %1
+; CHECK-NEXT: store volatile i32 %D, ptr %4
+; CHECK-NEXT: store volatile i32 %D, ptr %4
+; CHECK-NEXT: %M = fmul nnan float %2, %3
+; CHECK-NEXT: store volatile float %M, ptr %4
+; CHECK-NEXT: store volatile float %M, ptr %4
+; CHECK-NEXT: %S = sub i32 %0, %1
+; CHECK-NEXT: %S1 = sub i32 %1, %0
+; CHECK-NEXT: store volatile i32 %S, ptr %4
+; CHECK-NEXT: store volatile i32 %S1, ptr %4
+; CHECK-NEXT: %C = icmp slt i32 %0, %1
+; CHECK-NEXT: store volatile i1 %C, ptr %4
+; CHECK-NEXT: store volatile i1 %C, ptr %4
+; CHECK-NEXT: %F = fcmp olt float %2, %3
+; CHECK-NEXT: store volatile i1 %F, ptr %4
+; CHECK-NEXT: store volatile i1 %F, ptr %4
+; CHECK-NEXT: ret void
+BB:
+  %A = add i32 %0, %1
+  %A1 = add i32 %1, %0
+  store volatile i32 %A, ptr %4, align 4
+  store volatile i32 %A1, ptr %4, align 4
+  %N = add nsw i32 %1, %0
+  store volatile i32 %N, ptr %4, align 4
+  %D = udiv exact i32 %0, %1
+  %D1 = udiv i32 %0, %1
+  store volatile i32 %D, ptr %4, align 4
+  store volatile i32 %D1, ptr %4, align 4
+  %M = fmul fast float %2, %3
+  %M1 = fmul nnan float %3, %2
+  store volatile float %M, ptr %4, align 4
+  store volatile float %M1, ptr %4, align 4
+  %S = sub i32 %0, %1
+  %S1 = sub i32 %1, %0
+  store volatile i32 %S, ptr %4, align 4
+  store volatile i32 %S1, ptr %4, align 4
+  %C = icmp slt i32 %0, %1
+  %C1 = icmp sgt i32 %1, %0
+  store volatile i1 %C, ptr %4, align 1
+  store volatile i1 %C1, ptr %4, align 1
+  %F = fcmp olt float %2, %3
+  %F1 = fcmp ogt float %3, %2
+  store volatile i1 %F, ptr %4, align 1
+  store volatile i1 %F1, ptr %4, align 1
+  ret void
+}
@@ -0,0 +1,58 @@
+; ModuleID = 'cse12'
+; CHECK-LABEL: source_filename = "cse12"
+source_filename = "cse12"
+
+; (a + c) + b is rebuilt as (a + b) + c, which CSE then merges with (b + a) + c,
+; so the xor of the two folds to 0. Constants are combined last and folded into
+; one, and the rebuilt additions drop nsw. Floating point additions are only
+; reassociated with the reassoc and nsz flags.
+; CHECK-LABEL: @cse12(i32 %0, i32 %1, i32 %2, float %3, float %4, float %5, ptr %6) {
+define void @cse12(i32 %0, i32 %1, i32 %2, float %3, float %4, float %5, ptr %6) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: store volatile i32 0, ptr %6
+; CHECK-NEXT: [[K:%.*]] = add i32 %0, %2
+; CHECK-NEXT: [[K8:%.*]] = add i32 [[K]], 8
+; CHECK-NEXT: store volatile i32 [[K8]], ptr %6
+; CHECK-NEXT: [[F:%.*]] = fadd reassoc nsz float %3, %4
+; CHECK-NEXT: [[F5:%.*]] = fadd reassoc nsz float [[F]], %5
+; CHECK-NEXT: store volatile float [[F5]], ptr %6
+; CHECK-NEXT: %G1 = fadd float %5, %4
+; CHECK-NEXT: %G2 = fadd float %G1, %3
+; CHECK-NEXT: store volatile float %G2, ptr %6
+; CHECK-NEXT: ret void
+BB:
+  %AC = add i32 %0, %2
+  %X = add i32 %AC, %1
+  %BA = add i32 %1, %0
+  %Y = add i32 %BA, %2
+  %R = xor i32 %X, %Y
+  store volatile i32 %R, ptr %6, align 4
+  %K1 = add nsw i32 %0, 3
+  %K2 = add nsw i32 %K1, %2
+  %K3 = add nsw i32 %K2, 5
+  store volatile i32 %K3, ptr %6, align 4
+  %F1 = fadd reassoc nsz float %5, %3
+  %F2 = fadd reassoc nsz float %F1, %4
+  store volatile float %F2, ptr %6, align 4
+  %G1 = fadd float %5, %4
+  %G2 = fadd float %G1, %3
+  store volatile float %G2, ptr %6, align 4
+  ret void
+}
+
+; %S1 is an inner node of the tree of %X, but CSE merges it with %S2, so it is
+; kept as a leaf and the tree is left as it is.
+; CHECK-LABEL: @cse12_shared(i32 %0, i32 %1, i32 %2, ptr %3) {
+define void @cse12_shared(i32 %0, i32 %1, i32 %2, ptr %3) {
+; CHECK-NEXT: %S1 = add i32 %0, %2
+; CHECK-NEXT: %X = add i32 %S1, %1
+; CHECK-NEXT: store volatile i32 %X, ptr %3
+; CHECK-NEXT: store volatile i32 %S1, ptr %3
+; CHECK-NEXT: ret void
+  %S1 = add i32 %0, %2
+  %X = add i32 %S1, %1
+  %S2 = add i32 %2, %0
+  store volatile i32 %X, ptr %3, align 4
+  store volatile i32 %S2, ptr %3, align 4
+  ret void
+}
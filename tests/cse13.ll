@@ -0,0 +1,57 @@
+; ModuleID = 'cse13'
+; CHECK-LABEL: source_filename = "cse13"
+source_filename = "cse13"
+
+@G = global i32 0, align 4
+
+declare i32 @pure(i32) #0
+declare i32 @peek(ptr) #1
+declare void @opaque()
+
+; A call that does not access memory is merged with a dominating identical
+; call, even across blocks and the opaque call in between. A call that only
+; reads memory is merged within a block while nothing in between may write
+; what it reads: the store to the local does not stop it, the store to @G does.
+; CHECK-LABEL: @cse13(i32 %0, ptr %1, i1 %2) {
+define void @cse13(i32 %0, ptr %1, i1 %2) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: %A = alloca i32
+; CHECK-NEXT: %P = call i32 @pure(i32 %0)
+; CHECK-NEXT: store volatile i32 %P, ptr %1
+; CHECK-NEXT: %R = call i32 @peek(ptr @G)
+; CHECK-NEXT: store i32 %0, ptr %A
+; CHECK-NEXT: store volatile i32 %R, ptr %1
+; CHECK-NEXT: store volatile i32 %R, ptr %1
+; CHECK-NEXT: store i32 %0, ptr @G
+; CHECK-NEXT: %R2 = call i32 @peek(ptr @G)
+; CHECK-NEXT: store volatile i32 %R2, ptr %1
+; CHECK-NEXT: call void @opaque()
+; CHECK-NEXT: br i1 %2, label %Then, label %Exit
+; CHECK: Then:
+; CHECK-NEXT: store volatile i32 %P, ptr %1
+BB:
+  %A = alloca i32, align 4
+  %P = call i32 @pure(i32 %0)
+  store volatile i32 %P, ptr %1, align 4
+  %R = call i32 @peek(ptr @G)
+  store i32 %0, ptr %A, align 4
+  %R1 = call i32 @peek(ptr @G)
+  store volatile i32 %R, ptr %1, align 4
+  store volatile i32 %R1, ptr %1, align 4
+  store i32 %0, ptr @G, align 4
+  %R2 = call i32 @peek(ptr @G)
+  store volatile i32 %R2, ptr %1, align 4
+  call void @opaque()
+  br i1 %2, label %Then, label %Exit
+
+Then:
+  %P1 = call i32 @pure(i32 %0)
+  store volatile i32 %P1, ptr %1, align 4
+  br label %Exit
+
+Exit:
+  ret void
+}
+
+attributes #0 = { nounwind willreturn memory(none) }
+attributes #1 = { nounwind willreturn memory(read) }
@@ -0,0 +1,144 @@
+; ModuleID = 'cse14'
+; CHECK-LABEL: source_filename = "cse14"
+source_filename = "cse14"
+
+@G = global i32 0, align 4
+
+; With -infer-attrs the callees are found not to access memory, or to only
+; read the memory behind their argument, before their callers are optimized.
+; CHECK-LABEL: define i32 @square(
+; CHECK-SAME: i32 %0) [[NONE:#[0-9]+]] {
+define i32 @square(i32 %0) {
+  %2 = mul i32 %0, %0
+  ret i32 %2
+}
+
+; CHECK-LABEL: define i32 @get(
+; CHECK-SAME: ptr nocapture %0) [[ARGREAD:#[0-9]+]] {
+define i32 @get(ptr %0) {
+  %2 = load i32, ptr %0, align 4
+  ret i32 %2
+}
+
+; Both functions of a recursive SCC get the effects of the whole SCC
+; CHECK-LABEL: define i32 @even(
+; CHECK-SAME: i32 %0) [[NONE]] {
+define i32 @even(i32 %0) {
+  %2 = icmp eq i32 %0, 0
+  br i1 %2, label %Done, label %Next
+Done:
+  ret i32 1
+Next:
+  %3 = sub i32 %0, 1
+  %4 = call i32 @odd(i32 %3)
+  ret i32 %4
+}
+
+; CHECK-LABEL: define i32 @odd(
+; CHECK-SAME: i32 %0) [[NONE]] {
+define i32 @odd(i32 %0) {
+  %2 = icmp eq i32 %0, 0
+  br i1 %2, label %Done, label %Next
+Done:
+  ret i32 0
+Next:
+  %3 = sub i32 %0, 1
+  %4 = call i32 @even(i32 %3)
+  ret i32 %4
+}
+
+; The pointer passed within the SCC is written like the argument it is passed
+; as, so @rec writes @G as well as argument memory
+; CHECK-LABEL: define void @rec(
+; CHECK-SAME: ptr nocapture %0, i32 %1) [[WRITE:#[0-9]+]] {
+define void @rec(ptr %0, i32 %1) {
+  store i32 1, ptr %0, align 4
+  %3 = icmp eq i32 %1, 0
+  br i1 %3, label %Done, label %Next
+Done:
+  ret void
+Next:
+  %4 = sub i32 %1, 1
+  call void @rec(ptr @G, i32 %4)
+  ret void
+}
+
+; A function that writes a global keeps its calls
+; CHECK-LABEL: define void @bump(
+; CHECK-SAME: ) [[OTHER:#[0-9]+]] {
+define void @bump() {
+  %1 = load i32, ptr @G, align 4
+  %2 = add i32 %1, 1
+  store i32 %2, ptr @G, align 4
+  ret void
+}
+
+; The repeated calls are merged, and the store to the local is forwarded
+; past the calls that cannot write it. Only reading through %1 is left, so
+; the caller itself only reads argument memory and does not capture %1.
+; CHECK-LABEL: define i32 @cse14(
+; CHECK-SAME: i32 %0, ptr nocapture %1) [[ARGREAD]] {
+define i32 @cse14(i32 %0, ptr %1) {
+; CHECK-NEXT: %A = alloca i32
+; CHECK-NEXT: store i32 %0, ptr %A
+; CHECK-NEXT: %S1 = call i32 @square(i32 %0)
+; CHECK-NEXT: %E1 = call i32 @even(i32 %0)
+; CHECK-NEXT: %G1 = call i32 @get(ptr %1)
+; CHECK-NEXT: %X = add i32 %S1, %S1
+; CHECK-NEXT: %Y = add i32 %E1, %E1
+; CHECK-NEXT: %Z = add i32 %G1, %G1
+; CHECK-NEXT: %R1 = sub i32 %X, %Y
+; CHECK-NEXT: %R2 = sub i32 %R1, %Z
+; CHECK-NEXT: %R3 = sub i32 %R2, %0
+; CHECK-NEXT: ret i32 %R3
+  %A = alloca i32, align 4
+  store i32 %0, ptr %A, align 4
+  %S1 = call i32 @square(i32 %0)
+  %E1 = call i32 @even(i32 %0)
+  %G1 = call i32 @get(ptr %1)
+  %S2 = call i32 @square(i32 %0)
+  %E2 = call i32 @even(i32 %0)
+  %G2 = call i32 @get(ptr %1)
+  %L = load i32, ptr %A, align 4
+  %X = add i32 %S1, %S2
+  %Y = add i32 %E1, %E2
+  %Z = add i32 %G1, %G2
+  %R1 = sub i32 %X, %Y
+  %R2 = sub i32 %R1, %Z
+  %R3 = sub i32 %R2, %L
+  ret i32 %R3
+}
+
+; CHECK-LABEL: define void @cse14_bump(
+; CHECK-SAME: ) [[OTHER]] {
+define void @cse14_bump() {
+; CHECK-NEXT: call void @bump()
+; CHECK-NEXT: call void @bump()
+; CHECK-NEXT: ret void
+  call void @bump()
+  call void @bump()
+  ret void
+}
+
+; The call to @rec may write @G, so the second load stays
+; CHECK-LABEL: define i32 @cse14_rec(
+; CHECK-SAME: i32 %0) [[OTHER]] {
+define i32 @cse14_rec(i32 %0) {
+; CHECK-NEXT: %A = alloca i32
+; CHECK-NEXT: %L1 = load i32, ptr @G
+; CHECK-NEXT: call void @rec(ptr %A, i32 %0)
+; CHECK-NEXT: %L2 = load i32, ptr @G
+; CHECK-NEXT: %R = sub i32 %L1, %L2
+; CHECK-NEXT: ret i32 %R
+  %A = alloca i32, align 4
+  %L1 = load i32, ptr @G, align 4
+  call void @rec(ptr %A, i32 %0)
+  %L2 = load i32, ptr @G, align 4
+  %R = sub i32 %L1, %L2
+  ret i32 %R
+}
+
+; CHECK-DAG: attributes [[NONE]] = { memory(none) }
+; CHECK-DAG: attributes [[ARGREAD]] = { memory(argmem: read) }
+; CHECK-DAG: attributes [[OTHER]] = { memory(readwrite, argmem: none, inaccessiblemem: none) }
+; CHECK-DAG: attributes [[WRITE]] = { memory(write, inaccessiblemem: none) }
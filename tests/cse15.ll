@@ -0,0 +1,58 @@
+; ModuleID = 'cse15'
+; CHECK-LABEL: source_filename = "cse15"
+source_filename = "cse15"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = global double 0.000000e+00, align 8
+
+declare double @sqrt(double)
+declare double @sin(double)
+declare float @cosf(float)
+declare double @pow(double, double)
+
+; With -no-math-errno the math library calls only compute their result: the
+; repeated calls are merged, the unused call and the call on a constant go
+; away, and the store to @G is forwarded past the calls. The call marked
+; nobuiltin is not known to be the library function and stays.
+; CHECK-LABEL: @cse15(double %0, float %1) {
+define double @cse15(double %0, float %1) {
+; CHECK-NEXT: store double %0, ptr @G
+; CHECK-NEXT: %S1 = call double @sqrt(double %0) [[MATH:#[0-9]+]]
+; CHECK-NEXT: %C1 = call float @cosf(float %1) [[MATH]]
+; CHECK-NEXT: %P1 = call double @pow(double %0, double %S1) [[MATH]]
+; CHECK-NEXT: %N = call double @sin(double %0) [[NOBUILTIN:#[0-9]+]]
+; CHECK-NEXT: %A = fadd double %S1, %S1
+; CHECK-NEXT: %B = fadd double %P1, %P1
+; CHECK-NEXT: %CS = fadd float %C1, %C1
+; CHECK-NEXT: %CD = fpext float %CS to double
+; CHECK-NEXT: %R1 = fadd double %A, %B
+; CHECK-NEXT: %R2 = fadd double %R1, %CD
+; CHECK-NEXT: %R3 = fadd double %R2, 0x3FDEAEE8744B05F0
+; CHECK-NEXT: %R4 = fadd double %R3, %0
+; CHECK-NEXT: %R5 = fadd double %R4, %N
+; CHECK-NEXT: ret double %R5
+  store double %0, ptr @G, align 8
+  %S1 = call double @sqrt(double %0)
+  %C1 = call float @cosf(float %1)
+  %C2 = call float @cosf(float %1)
+  %S2 = call double @sqrt(double %0)
+  %P1 = call double @pow(double %0, double %S1)
+  %P2 = call double @pow(double %0, double %S2)
+  %Unused = call double @sqrt(double %S2)
+  %K = call double @sin(double 5.000000e-01)
+  %L = load double, ptr @G, align 8
+  %N = call double @sin(double %0) nobuiltin
+  %A = fadd double %S1, %S2
+  %B = fadd double %P1, %P2
+  %CS = fadd float %C1, %C2
+  %CD = fpext float %CS to double
+  %R1 = fadd double %A, %B
+  %R2 = fadd double %R1, %CD
+  %R3 = fadd double %R2, %K
+  %R4 = fadd double %R3, %L
+  %R5 = fadd double %R4, %N
+  ret double %R5
+}
+
+; CHECK-DAG: attributes [[MATH]] = { nounwind willreturn memory(none) }
+; CHECK-DAG: attributes [[NOBUILTIN]] = { nobuiltin }
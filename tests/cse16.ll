@@ -0,0 +1,67 @@
+; ModuleID = 'cse16'
+; CHECK-LABEL: source_filename = "cse16"
+source_filename = "cse16"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+
+%struct.S = type { i32, i32, i64 }
+
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1)
+declare void @llvm.memcpy.p0.p0.i64(ptr, ptr, i64, i1)
+
+; Stores the memset and the memcpy overwrite are dead, loads of the memset
+; bytes read 0, and loads of the memcpy bytes read the source instead, where
+; the field of %0 was loaded before, until the store through %1 may change it.
+; CHECK-LABEL: @cse16(ptr %0, ptr %1) {
+define i64 @cse16(ptr %0, ptr %1) {
+; CHECK-NEXT: %A = alloca %struct.S
+; CHECK-NEXT: %B = alloca %struct.S
+; CHECK-NEXT: call void @llvm.memset.p0.i64(ptr %A, i8 0, i64 16, i1 false)
+; CHECK-NEXT: %G0 = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 2
+; CHECK-NEXT: %L0 = load i64, ptr %G0
+; CHECK-NEXT: %H = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 1
+; CHECK-NEXT: %LH = load i32, ptr %H
+; CHECK-NEXT: call void @llvm.memcpy.p0.p0.i64(ptr align 8 %B, ptr align 8 %0, i64 16, i1 false)
+; CHECK-NEXT: %L4 = load i32, ptr %0, align 8
+; CHECK-NEXT: store i32 1, ptr %1
+; CHECK-NEXT: %G2 = getelementptr inbounds %struct.S, ptr %B, i32 0, i32 1
+; CHECK-NEXT: %L5 = load i32, ptr %G2
+; CHECK-NEXT: %W4 = zext i32 %L4 to i64
+; CHECK-NEXT: %W5 = zext i32 %L5 to i64
+; CHECK-NEXT: %WH = zext i32 %LH to i64
+; CHECK-NEXT: %R1 = sub i64 %L0, %W4
+; CHECK-NEXT: %R2 = sub i64 %R1, %W5
+; CHECK-NEXT: %R3 = sub i64 %R2, %WH
+; CHECK-NEXT: %R4 = add i64 %R3, %L0
+; CHECK-NEXT: ret i64 %R4
+  %A = alloca %struct.S, align 8
+  %B = alloca %struct.S, align 8
+  %F1 = getelementptr inbounds %struct.S, ptr %A, i32 0, i32 1
+  store i32 7, ptr %F1, align 4
+  call void @llvm.memset.p0.i64(ptr %A, i8 0, i64 16, i1 false)
+  %L1 = load i32, ptr %F1, align 4
+  %F2 = getelementptr inbounds %struct.S, ptr %A, i32 0, i32 2
+  %L2 = load i64, ptr %F2, align 8
+  %G0 = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 2
+  %L0 = load i64, ptr %G0, align 8
+  %H = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 1
+  %LH = load i32, ptr %H, align 4
+  %G1 = getelementptr inbounds %struct.S, ptr %B, i32 0, i32 2
+  store i64 9, ptr %G1, align 8
+  call void @llvm.memcpy.p0.p0.i64(ptr align 8 %B, ptr align 8 %0, i64 16, i1 false)
+  %L3 = load i64, ptr %G1, align 8
+  %L4 = load i32, ptr %B, align 4
+  store i32 1, ptr %1, align 4
+  %G2 = getelementptr inbounds %struct.S, ptr %B, i32 0, i32 1
+  %L5 = load i32, ptr %G2, align 4
+  %W1 = zext i32 %L1 to i64
+  %W4 = zext i32 %L4 to i64
+  %W5 = zext i32 %L5 to i64
+  %WH = zext i32 %LH to i64
+  %R0 = add i64 %L0, %W1
+  %R1 = sub i64 %L3, %W4
+  %R2 = sub i64 %R1, %W5
+  %R3 = sub i64 %R2, %WH
+  %R4 = add i64 %R3, %R0
+  %R5 = add i64 %R4, %L2
+  ret i64 %R5
+}
@@ -0,0 +1,38 @@
+; ModuleID = 'cse17'
+; CHECK-LABEL: source_filename = "cse17"
+source_filename = "cse17"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+
+%struct.S = type { i32, i32, i64 }
+
+; The GEPs differ, but compute the same field of the same pointer, so loads
+; and stores through them access the same address.
+; CHECK-LABEL: @cse17(ptr %0, ptr %1, i64 %2) {
+define i64 @cse17(ptr %0, ptr %1, i64 %2) {
+; CHECK-NEXT: %F1 = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 1
+; CHECK-NEXT: %L1 = load i32, ptr %F1
+; CHECK-NEXT: %Q = getelementptr inbounds i64, ptr %0, i64 1
+; CHECK-NEXT: store i64 %2, ptr %Q
+; CHECK-NEXT: %H2 = getelementptr inbounds %struct.S, ptr %1, i32 0, i32 1
+; CHECK-NEXT: store i32 %L1, ptr %H2
+; CHECK-NEXT: %S = shl i32 %L1, %L1
+; CHECK-NEXT: %W = zext i32 %S to i64
+; CHECK-NEXT: %R = sub i64 %W, %2
+; CHECK-NEXT: ret i64 %R
+  %F1 = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 1
+  %L1 = load i32, ptr %F1, align 4
+  %B1 = getelementptr inbounds i8, ptr %0, i64 4
+  %L2 = load i32, ptr %B1, align 4
+  %Q = getelementptr inbounds i64, ptr %0, i64 1
+  store i64 %2, ptr %Q, align 8
+  %F2 = getelementptr inbounds %struct.S, ptr %0, i32 0, i32 2
+  %L3 = load i64, ptr %F2, align 8
+  %H1 = getelementptr inbounds i8, ptr %1, i64 4
+  store i32 0, ptr %H1, align 4
+  %H2 = getelementptr inbounds %struct.S, ptr %1, i32 0, i32 1
+  store i32 %L2, ptr %H2, align 4
+  %S = shl i32 %L1, %L2
+  %W = zext i32 %S to i64
+  %R = sub i64 %W, %L3
+  ret i64 %R
+}
@@ -0,0 +1,31 @@
+; ModuleID = 'cse18'
+; CHECK-LABEL: source_filename = "cse18"
+source_filename = "cse18"
+
+declare void @use(i32, i32, i32, i32, i32, i32, i32, i32)
+
+; Plain loads take the value of any earlier load of the address. An unordered
+; atomic load only takes the value of an earlier atomic load, never that of a
+; plain load or store, and acquire loads are never replaced.
+; CHECK-LABEL: @cse18(ptr %0, ptr %1, ptr %2, i32 %3) {
+define void @cse18(ptr %0, ptr %1, ptr %2, i32 %3) {
+; CHECK-NEXT: %L1 = load i32, ptr %0
+; CHECK-NEXT: %L2 = load atomic i32, ptr %0 unordered
+; CHECK-NEXT: store i32 %3, ptr %1
+; CHECK-NEXT: %L5 = load atomic i32, ptr %1 unordered
+; CHECK-NEXT: %L7 = load atomic i32, ptr %2 acquire
+; CHECK-NEXT: %L8 = load atomic i32, ptr %2 acquire
+; CHECK-NEXT: call void @use(i32 %L1, i32 %L2, i32 %L1, i32 %L2, i32 %L5, i32 %L5, i32 %L7, i32 %L8)
+; CHECK-NEXT: ret void
+  %L1 = load i32, ptr %0, align 4
+  %L2 = load atomic i32, ptr %0 unordered, align 4
+  %L3 = load i32, ptr %0, align 4
+  %L4 = load atomic i32, ptr %0 unordered, align 4
+  store i32 %3, ptr %1, align 4
+  %L5 = load atomic i32, ptr %1 unordered, align 4
+  %L6 = load i32, ptr %1, align 4
+  %L7 = load atomic i32, ptr %2 acquire, align 4
+  %L8 = load atomic i32, ptr %2 acquire, align 4
+  call void @use(i32 %L1, i32 %L2, i32 %L3, i32 %L4, i32 %L5, i32 %L6, i32 %L7, i32 %L8)
+  ret void
+}
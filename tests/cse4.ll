@@ -7,7 +7,7 @@ source_filename = "cse4"
 define i32 @cse4(ptr %0, ptr %1, ptr %2, i32 %3, i64 %4, i8 %5) {
 ; CHECK-NEXT: BB
 ; CHECK-NEXT: alloca
-; CHECK-NEXT: alloca
+; The unused alloca is dead
 ; CHECK-NEXT: store
 ; CHECK-NEXT: ret i32
 BB:
@@ -6,7 +6,7 @@ source_filename = "cse5"
 define void @cse5(ptr %0, ptr %1, ptr %2, i32 %3, i64 %4, i8 %5) {
 ; CHECK-NEXT: BB
 ; CHECK-NEXT: alloca
-; CHECK-NEXT: alloca
+; The unused alloca is dead
 ; CHECK-NEXT: store
 ; CHECK-NEXT: ret void
 
@@ -17,3 +17,23 @@ BB:
   store i32 0, ptr %A, align 4
   ret void
 }
+
+; Atomic stores that order other accesses stay, and an unordered atomic store
+; is only removed by a later store that is atomic as well
+; CHECK-LABEL: void @cse5_atomic(ptr %0, ptr %1, ptr %2, i32 %3)
+define void @cse5_atomic(ptr %0, ptr %1, ptr %2, i32 %3) {
+; CHECK-NEXT: store atomic i32 1, ptr %0 release
+; CHECK-NEXT: store i32 %3, ptr %0
+; CHECK-NEXT: store atomic i32 2, ptr %1 unordered
+; CHECK-NEXT: store i32 %3, ptr %1
+; CHECK-NEXT: store atomic i32 4, ptr %2 unordered
+; CHECK-NEXT: ret void
+  store atomic i32 1, ptr %0 release, align 4
+  store i32 %3, ptr %0, align 4
+  store atomic i32 2, ptr %1 unordered, align 4
+  store i32 %3, ptr %1, align 4
+  store i32 3, ptr %2, align 4
+  store atomic i32 %3, ptr %2 unordered, align 4
+  store atomic i32 4, ptr %2 unordered, align 4
+  ret void
+}
@@ -0,0 +1,76 @@
+; ModuleID = 'cse7'
+; CHECK-LABEL: source_filename = "cse7"
+source_filename = "cse7"
+
+; Run with -memssa-loads: loads and stores in dominating blocks make these loads redundant
+; CHECK-LABEL: @cse7(ptr %0, i32 %1, i1 %2) {
+define i32 @cse7(ptr %0, i32 %1, i1 %2) {
+; CHECK-NEXT: BB
+; CHECK-NEXT: alloca
+; CHECK-NEXT: store i32 %1, ptr %A
+; CHECK-NEXT: %L = load i32, ptr %0
+; CHECK-NEXT: br
+BB:
+  %A = alloca i32, align 4
+  store i32 %1, ptr %A, align 4
+  %L = load i32, ptr %0, align 4
+  br i1 %2, label %T, label %F
+
+; CHECK: T:
+; CHECK-NEXT: %S = add i32 %1, %L
+; CHECK-NEXT: store i32 %S, ptr %0
+; CHECK-NEXT: br
+T:
+  %L1 = load i32, ptr %A, align 4
+  %L2 = load i32, ptr %0, align 4
+  %S = add i32 %L1, %L2
+  store i32 %S, ptr %0, align 4
+  br label %J
+
+F:
+  br label %J
+
+; The store in T may have changed %0, so %L3 stays. The sum is reassociated
+; to add the values of the entry block first.
+; CHECK: J:
+; CHECK-NEXT: %L3 = load i32, ptr %0
+; CHECK-NEXT: [[R:%.*]] = add i32 %1, %L
+; CHECK-NEXT: [[R1:%.*]] = add i32 [[R]], %L3
+; CHECK-NEXT: ret i32 [[R1]]
+J:
+  %L3 = load i32, ptr %0, align 4
+  %L4 = load i32, ptr %A, align 4
+  %R = add i32 %L3, %L4
+  %R1 = add i32 %R, %L
+  ret i32 %R1
+}
+
+; The loads in T follow a plain load and a plain store of their addresses, so
+; neither the unordered atomic loads nor the acquire load reuse those values
+; CHECK-LABEL: @cse7_atomic(ptr %0, ptr %1, i32 %2, i1 %3) {
+define i32 @cse7_atomic(ptr %0, ptr %1, i32 %2, i1 %3) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: %L1 = load i32, ptr %0
+; CHECK-NEXT: store i32 %2, ptr %1
+; CHECK-NEXT: br
+BB:
+  %L1 = load i32, ptr %0, align 4
+  store i32 %2, ptr %1, align 4
+  br i1 %3, label %T, label %F
+
+; CHECK: T:
+; CHECK-NEXT: %L2 = load atomic i32, ptr %0 unordered
+; CHECK-NEXT: %L3 = load atomic i32, ptr %1 unordered
+; CHECK-NEXT: %L4 = load atomic i32, ptr %0 acquire
+T:
+  %L2 = load atomic i32, ptr %0 unordered, align 4
+  %L3 = load atomic i32, ptr %1 unordered, align 4
+  %L4 = load atomic i32, ptr %0 acquire, align 4
+  %S = add i32 %L2, %L3
+  %S1 = add i32 %S, %L4
+  br label %F
+
+F:
+  %P = phi i32 [ %S1, %T ], [ %L1, %BB ]
+  ret i32 %P
+}
@@ -0,0 +1,28 @@
+; ModuleID = 'cse8'
+; CHECK-LABEL: source_filename = "cse8"
+source_filename = "cse8"
+
+declare i32 @pure(i32) #0
+declare i32 @impure(i32)
+
+; The unused result keeps nothing alive: the whole chain is dead, including the
+; call that cannot write memory. The call with side effects stays.
+; CHECK-LABEL: @cse8(ptr %0, i32 %1) {
+define i32 @cse8(ptr %0, i32 %1) {
+; CHECK-NEXT: BB
+; CHECK-NEXT: call i32 @impure(i32 %1)
+; CHECK-NEXT: ret i32 %1
+BB:
+  %A = alloca i32, align 4
+  %L = load i32, ptr %0, align 4
+  %M = mul i32 %L, %1
+  %C = call i32 @pure(i32 %M)
+  %G = getelementptr inbounds i32, ptr %A, i32 %C
+  %I = call i32 @impure(i32 %1)
+  %X = xor i32 %I, %C
+  %Z = zext i32 %X to i64
+  %E = icmp eq i64 %Z, 0
+  ret i32 %1
+}
+
+attributes #0 = { nounwind readnone willreturn }
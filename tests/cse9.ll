@@ -0,0 +1,100 @@
+; ModuleID = 'cse9'
+; CHECK-LABEL: source_filename = "cse9"
+source_filename = "cse9"
+
+; Run with -aggressive-dce: the branch to %Dead is folded and the block deleted,
+; after which the running sum %S only feeds itself and is removed too
+; CHECK-LABEL: @cse9(i32 %0, ptr %1) {
+define i32 @cse9(i32 %0, ptr %1) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: br label %Loop
+BB:
+  br label %Loop
+
+; CHECK: Loop:
+; CHECK-NEXT: %I = phi i32
+; CHECK-NEXT: %I1 = add i32 %I, 1
+; CHECK-NEXT: %C = icmp slt i32 %I1, %0
+; CHECK-NEXT: br i1 %C, label %Loop, label %Exit
+Loop:
+  %I = phi i32 [ 0, %BB ], [ %I1, %Loop ]
+  %S = phi i32 [ 0, %BB ], [ %S1, %Loop ]
+  %S1 = add i32 %S, %I
+  %I1 = add i32 %I, 1
+  %C = icmp slt i32 %I1, %0
+  br i1 %C, label %Loop, label %Exit
+
+; CHECK: Exit:
+; CHECK-NEXT: br label %Ret
+; CHECK-NOT: Dead:
+; CHECK: Ret:
+; CHECK-NEXT: ret i32 %I1
+Exit:
+  br i1 true, label %Ret, label %Dead
+
+Dead:
+  store i32 %S1, ptr %1, align 4
+  br label %Ret
+
+Ret:
+  %R = phi i32 [ 0, %Exit ], [ 1, %Dead ]
+  ret i32 %I1
+}
+
+; Both edges of a branch lead to the same block, whose PHIs list the branching
+; block twice. Folding the branch leaves a single entry for it
+; CHECK-LABEL: @cse9_same(i32 %0, i1 %1, i1 %2) {
+define i32 @cse9_same(i32 %0, i1 %1, i1 %2) {
+; CHECK-NEXT: Top:
+; CHECK-NEXT: br i1 %1, label %Side, label %Join
+Top:
+  br i1 %1, label %Side, label %Join
+
+; CHECK: Side:
+; CHECK-NEXT: br label %Join
+Side:
+  br i1 %2, label %Join, label %Join
+
+; CHECK: Join:
+; CHECK-NEXT: %P = phi i32 [ 5, %Side ], [ %0, %Top ]
+; CHECK-NEXT: ret i32 %P
+Join:
+  %P = phi i32 [ 5, %Side ], [ 5, %Side ], [ %0, %Top ]
+  ret i32 %P
+}
+
+; The PHIs of %Join differ only in their entry for %Mid, and already have a
+; fingerprint when the constant branch in %Mid is folded. Dropping that entry
+; makes them equal, so the second one is replaced with the first
+; CHECK-LABEL: @cse9_phis(i32 %0, i32 %1, i1 %2, i1 %3) {
+define i32 @cse9_phis(i32 %0, i32 %1, i1 %2, i1 %3) {
+; CHECK-NEXT: Top:
+; CHECK-NEXT: br i1 %2, label %A, label %B
+Top:
+  %C = icmp eq i32 %0, %0
+  br i1 %2, label %A, label %B
+
+A:
+  br i1 %3, label %Join, label %Mid
+
+B:
+  br label %Join
+
+; CHECK: Mid:
+; CHECK-NEXT: br label %Other
+Mid:
+  br i1 %C, label %Other, label %Join
+
+Other:
+  ret i32 0
+
+; CHECK: Join:
+; CHECK-NEXT: %P1 = phi i32 [ %0, %A ], [ %1, %B ]
+; CHECK-NEXT: %R = add i32 %P1, %P1
+; CHECK-NEXT: ret i32 %R
+Join:
+  %P1 = phi i32 [ %0, %A ], [ %1, %B ], [ 7, %Mid ]
+  %P2 = phi i32 [ %0, %A ], [ %1, %B ], [ 8, %Mid ]
+  %R = add i32 %P1, %P2
+  ret i32 %R
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Starts p2 -server, sends it requests and shuts it down.
+
+Usage: server.py <p2> [p2 options] -- <socket> <request>...
+
+A request is "path <input> <output>", which the server writes itself, or
+"buffer <input> <output>", whose bitcode and statistics come back over the
+socket and are written to <output> and <output>.stats.
+"""
+import os
+import socket
+import subprocess
+import sys
+import time
+
+
+def request(path, header, body=b''):
+    s = socket.socket(socket.AF_UNIX)
+    s.connect(path)
+    s.sendall(header.encode() + b'\n' + body)
+    reply = b''
+    while True:
+        data = s.recv(65536)
+        if not data:
+            break
+        reply += data
+    s.close()
+    status, _, rest = reply.partition(b'\n')
+    words = status.decode().split(' ')
+    if words[0] != 'ok':
+        sys.exit('%s: %s' % (header, status.decode()))
+    bitcode_size = int(words[1])
+    return rest[:bitcode_size], rest[bitcode_size:]
+
+
+def main():
+    split = sys.argv.index('--')
+    command = sys.argv[1:split]
+    sock = sys.argv[split + 1]
+
+    if os.path.exists(sock):
+        os.unlink(sock)
+    server = subprocess.Popen(command + ['-server', sock])
+    for _ in range(300):
+        if os.path.exists(sock) or server.poll() is not None:
+            break
+        time.sleep(0.1)
+
+    try:
+        for req in sys.argv[split + 2:]:
+            kind, inputfile, outputfile = req.split(' ')
+            if kind == 'path':
+                request(sock, req)
+                continue
+            with open(inputfile, 'rb') as f:
+                data = f.read()
+            bitcode, stats = request(sock, 'buffer %d' % len(data), data)
+            with open(outputfile, 'wb') as f:
+                f.write(bitcode)
+            with open(outputfile + '.stats', 'wb') as f:
+                f.write(stats)
+        request(sock, 'shutdown')
+        if server.wait(timeout=60) != 0:
+            sys.exit('p2 -server exited with %d' % server.returncode)
+    finally:
+        if server.poll() is None:
+            server.kill()
+
+
+if __name__ == '__main__':
+    main()